@@ -0,0 +1,379 @@
+/*
+* PotatoCHIP-8 - Benchmarks
+*
+* Microbenchmarks for every interpreter handler and for DRAW
+* across sprite sizes and clipping positions, end-to-end
+* headless runs of the bundled ROMs with scripted input, and
+* bulk disassembly throughput.
+* Results are printed to stdout as JSON (progress to stderr):
+* each benchmark runs warmup untimed repetitions, then reports
+* mean/median/min/max/stddev of ns per instruction (per frame for
+* end-to-end runs) over the timed ones, and instructions/sec and
+* frames/sec from the median.
+* Only instructions actually executed are counted; those fast-forwarded
+* by idle loop and WAIT_KEY skipping are reported separately ("skipped").
+* End-to-end runs are timed per frame because a mostly idle ROM executes
+* only a handful of instructions, whose average cost says nothing.
+*
+* Built and run by 'make bench'.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "chip8.h" // initialize_memory(), execute_cycles(), decode_op(), handler_name()
+#include "emulator.h" // loadROMData()
+#include "headless.h" // run_machine(), load_input_script(), elapsed_seconds()
+#include "jit.h" // jit_create(), jit_attach()
+#include "debugger.h" // disassemble_file()
+
+
+#define BODY_START 0x206        // After the 3-instruction prologue
+#define BODY_END 0xE00          // Body fills [BODY_START, BODY_END), then loops back
+#define SUBROUTINE 0xF00        // RET target for the CALL benchmark
+#define SCRATCH_INDEX 0xE80     // I for benchmarks that write memory
+#define MICRO_INSTRUCTIONS 1000000
+#define DRAW_INSTRUCTIONS 200000
+#define E2E_FRAMES 60000
+#define DISAS_COPIES 16          // Disassembly input: every opcode, DISAS_COPIES times (2 MB)
+#define BENCH_SEED 1
+#define JP_NEXT 0x1000          // Body opcode placeholder: "JP to the following instruction"
+
+#if defined(CHIP8_CORE_THREADED)
+	#define CORE_NAME "threaded"
+#elif defined(CHIP8_CORE_FLAT)
+	#define CORE_NAME "flat"
+#else
+	#define CORE_NAME "nested"
+#endif
+
+static struct { // Set by argparse()
+	int warmup;
+	int repetitions;
+	const char *rom_dir;
+	const char *input;
+} config = { 2, 10, "roms", "bench/input.in" };
+
+static int first_result = 1;
+
+
+/* One benchmarked opcode: prologue sets registers, body repeats opcode */
+struct micro_case{
+	uint16_t opcode;
+	uint16_t prologue[3]; // 0 = none
+};
+
+static const struct micro_case micro_cases[] = {
+	{ 0x00E0, { 0 } },                         // CLS
+	{ JP_NEXT, { 0 } },                        // JP
+	{ 0x2F00, { 0 } },                         // CALL (+ RET at SUBROUTINE)
+	{ 0x3A01, { 0x6A00 } },                    // SE (not taken)
+	{ 0x4A01, { 0x6A00 } },                    // SNE (taken, skips every other)
+	{ 0x5AB0, { 0x6A01, 0x6B02 } },            // SE Vx, Vy (not taken)
+	{ 0x6A12, { 0 } },                         // LD Vx, byte
+	{ 0x7A01, { 0 } },                         // ADD Vx, byte
+	{ 0x8AB0, { 0 } }, { 0x8AB1, { 0 } }, { 0x8AB2, { 0 } }, { 0x8AB3, { 0 } }, { 0x8AB4, { 0x6B03 } },
+	{ 0x8AB5, { 0x6B03 } }, { 0x8AB6, { 0 } }, { 0x8AB7, { 0x6B03 } }, { 0x8ABE, { 0 } },
+	{ 0x9AB0, { 0x6A01, 0x6B01 } },            // SNE Vx, Vy (not taken)
+	{ 0xA300, { 0 } },                         // LD I, addr
+	{ 0xB000 | BODY_START, { 0 } },            // JP V0, addr (V0 = 0: jumps to itself)
+	{ 0xCA7F, { 0 } },                         // RND
+	{ 0xD015, { 0xA000 } },                    // DRW (font sprite at 0, 0)
+	{ 0xEA9E, { 0 } },                         // SKP (no key: not taken)
+	{ 0xEAA1, { 0 } },                         // SKNP (no key: taken)
+	{ 0xFA07, { 0 } }, { 0xFA15, { 0 } }, { 0xFA18, { 0 } },
+	{ 0xFA1E, { 0x6A00 } },                    // ADD I, Vx (Vx = 0 keeps I in range)
+	{ 0xFA29, { 0 } },
+	{ 0xFA33, { 0xA000 | SCRATCH_INDEX } },    // LD B, Vx
+	{ 0xFA55, { 0xA000 | SCRATCH_INDEX } },    // LD [I], V0..Vx
+	{ 0xFA65, { 0xA000 | SCRATCH_INDEX } },    // LD V0..Vx, [I]
+};
+
+
+/* Summary of one benchmark's timed repetitions */
+struct stats{
+	double mean, median, min, max, stddev; // ns per instruction
+};
+
+static int compare_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static void summarize(double *samples, int count, struct stats *stats)
+{
+	qsort(samples, count, sizeof(double), compare_double);
+	double sum = 0, squares = 0;
+	for (int i = 0; i < count; i++) { sum += samples[i]; }
+	stats->mean = sum / count;
+	for (int i = 0; i < count; i++) { squares += (samples[i] - stats->mean) * (samples[i] - stats->mean); }
+	stats->stddev = (count > 1) ? sqrt(squares / (count - 1)) : 0.0;
+	stats->median = (count % 2) ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) / 2;
+	stats->min = samples[0];
+	stats->max = samples[count - 1];
+}
+
+
+/* Print one result object
+* - frames = 0 (microbenchmarks): stats are ns per instruction
+* - Otherwise (end-to-end): stats are ns per frame
+*/
+static void print_result(const char *group, const char *name, const char *detail, uint64_t instructions, uint64_t frames, const struct stats *stats)
+{
+	const char *unit = frames ? "frame" : "instruction";
+	double ips = frames ? 1e9 / stats->median * instructions / frames : 1e9 / stats->median;
+	printf("%s\n    {\"group\": \"%s\", \"name\": \"%s\", %s, \"instructions\": %llu, "
+		"\"ns_per_%s\": {\"mean\": %.3f, \"median\": %.3f, \"min\": %.3f, \"max\": %.3f, \"stddev\": %.3f}, "
+		"\"instructions_per_second\": %.0f",
+		first_result ? "" : ",", group, name, detail, (unsigned long long)instructions, unit,
+		stats->mean, stats->median, stats->min, stats->max, stats->stddev, ips);
+	if (frames) { printf(", \"frames\": %llu, \"frames_per_second\": %.0f", (unsigned long long)frames, 1e9 / stats->median); }
+	printf("}");
+	first_result = 0;
+	fprintf(stderr, "%-8s %-32s %8.3f ns/%s\n", group, name, stats->median, unit);
+}
+
+
+/* Fresh machine running rom (seeded, so RND benchmarks repeat exactly) */
+static int boot(struct Chip8Memory *machine, const uint8_t *rom, size_t size)
+{
+	if (initialize_memory(machine) != 0 || loadROMData(machine, rom, size) != 0) { return -1; }
+	seed_rng(machine, BENCH_SEED);
+	return 0;
+}
+
+/* Time count instructions warmup + repetitions times on one machine, summarize the timed runs */
+static void time_cycles(struct Chip8Memory *machine, uint64_t count, struct stats *stats)
+{
+	double samples[config.repetitions];
+	for (int r = -config.warmup; r < config.repetitions; r++)
+	{
+		struct timespec start, stop;
+		uint64_t skipped = machine->skipped;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		execute_cycles(machine, count);
+		clock_gettime(CLOCK_MONOTONIC, &stop);
+		skipped = machine->skipped - skipped;
+		if (r >= 0) { samples[r] = elapsed_seconds(&start, &stop) * 1e9 / (count - skipped); }
+	}
+	summarize(samples, config.repetitions, stats);
+}
+
+/* Prologue, then opcode repeated up to BODY_END, then two JPs back (a skip can only hop over one) */
+static size_t build_program(uint8_t *rom, const uint16_t prologue[3], uint16_t opcode)
+{
+	memset(rom, 0, TOTAL_RAM - RAM_RESERVED_SIZE);
+	for (int i = 0; i < 3; i++)
+	{
+		uint16_t op = prologue[i] ? prologue[i] : 0x6000 | 0x0E00; // LD VE, 0x00 as filler
+		rom[i * 2] = op >> 8;
+		rom[i * 2 + 1] = op & 0xFF;
+	}
+	for (uint16_t address = BODY_START; address < BODY_END + 4; address += 2)
+	{
+		uint16_t op = (address >= BODY_END) ? (0x1000 | BODY_START) : ((opcode == JP_NEXT) ? (0x1000 | (address + 2)) : opcode);
+		rom[address - 0x200] = op >> 8;
+		rom[address - 0x200 + 1] = op & 0xFF;
+	}
+	rom[SUBROUTINE - 0x200] = 0x00;
+	rom[SUBROUTINE - 0x200 + 1] = 0xEE;
+	return SUBROUTINE - 0x200 + 2;
+}
+
+
+static void bench_handlers(void)
+{
+	static uint8_t rom[TOTAL_RAM - RAM_RESERVED_SIZE];
+	static struct Chip8Memory machine;
+
+	for (size_t i = 0; i < sizeof(micro_cases) / sizeof(micro_cases[0]); i++)
+	{
+		const struct micro_case *c = &micro_cases[i];
+		size_t size = build_program(rom, c->prologue, c->opcode);
+		if (boot(&machine, rom, size) != 0) { continue; }
+
+		struct chip8_op op;
+		decode_op(&op, (c->opcode == JP_NEXT) ? 0x1000 : c->opcode);
+		char detail[64];
+		snprintf(detail, sizeof(detail), "\"opcode\": \"0x%04X\"", (c->opcode == JP_NEXT) ? 0x1000 : c->opcode);
+
+		struct stats stats;
+		time_cycles(&machine, MICRO_INSTRUCTIONS, &stats);
+		print_result("handler", (c->opcode == 0x2F00) ? "CALL+RET" : handler_name(op.handler), detail, MICRO_INSTRUCTIONS, 0, &stats);
+	}
+}
+
+
+static void bench_draw(void)
+{
+	static const uint8_t heights[] = { 1, 5, 8, 15 };
+	static const struct { uint8_t x, y; const char *where; } positions[] = {
+		{ 0, 0, "aligned" }, { 3, 0, "unaligned" }, { 60, 4, "right-clip" }, { 8, 28, "bottom-clip" }, { 62, 30, "corner-clip" },
+	};
+	static uint8_t rom[TOTAL_RAM - RAM_RESERVED_SIZE];
+	static struct Chip8Memory machine;
+
+	for (size_t h = 0; h < sizeof(heights); h++)
+	{
+		for (size_t p = 0; p < sizeof(positions) / sizeof(positions[0]); p++)
+		{
+			uint16_t prologue[3] = { 0x6000 | positions[p].x, 0x6100 | positions[p].y, 0xA000 };
+			size_t size = build_program(rom, prologue, 0xD010 | heights[h]);
+			if (boot(&machine, rom, size) != 0) { continue; }
+
+			char name[48], detail[96];
+			snprintf(name, sizeof(name), "DRAW n=%u %s", heights[h], positions[p].where);
+			snprintf(detail, sizeof(detail), "\"height\": %u, \"x\": %u, \"y\": %u", heights[h], positions[p].x, positions[p].y);
+
+			struct stats stats;
+			time_cycles(&machine, DRAW_INSTRUCTIONS, &stats);
+			print_result("draw", name, detail, DRAW_INSTRUCTIONS, 0, &stats);
+		}
+	}
+}
+
+
+/* Whole ROM for E2E_FRAMES frames at the default IPS, fresh machine every repetition, timed per frame */
+static void bench_rom(const char *file, const struct input_script *script, enum core_mode core)
+{
+	char path[512];
+	snprintf(path, sizeof(path), "%s/%s", config.rom_dir, file);
+	FILE *fp = fopen(path, "rb");
+	if (fp == NULL) { fprintf(stderr, "Skipping missing ROM '%s'\n", path); return; }
+	static uint8_t rom[TOTAL_RAM - RAM_RESERVED_SIZE];
+	size_t size = fread(rom, 1, sizeof(rom), fp);
+	fclose(fp);
+
+	static struct Chip8Memory machine;
+	struct chip8_jit *jit = NULL;
+	if (core == CORE_JIT && (jit = jit_create(0)) == NULL) { return; }
+
+	double samples[config.repetitions];
+	uint64_t executed = 0;
+	uint64_t skipped = 0;
+	for (int r = -config.warmup; r < config.repetitions; r++)
+	{
+		if (boot(&machine, rom, size) != 0) { break; }
+		if (jit) { jit_attach(jit, &machine); }
+
+		struct timespec start, stop;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		executed = run_machine(&machine, script, (uint64_t)E2E_FRAMES * CYCLES_PER_FRAME, CYCLES_PER_FRAME, NULL, &skipped);
+		clock_gettime(CLOCK_MONOTONIC, &stop);
+		if (r >= 0) { samples[r] = elapsed_seconds(&start, &stop) * 1e9 / E2E_FRAMES; }
+	}
+	if (jit) { jit_destroy(jit); }
+	if (executed + skipped == 0) { return; } // Machine never booted
+
+	struct stats stats;
+	summarize(samples, config.repetitions, &stats);
+	char name[128], detail[192];
+	snprintf(name, sizeof(name), "%s (%s)", file, (core == CORE_JIT) ? "jit" : "interp");
+	snprintf(detail, sizeof(detail), "\"rom\": \"%s\", \"core\": \"%s\", \"ips_setting\": %d, \"skipped\": %llu",
+		file, (core == CORE_JIT) ? "jit" : "interp", CYCLES_PER_FRAME * FRAME_RATE, (unsigned long long)skipped);
+	print_result("e2e", name, detail, executed, E2E_FRAMES, &stats);
+}
+
+static void bench_roms(void)
+{
+	static const char *roms[] = { "Pong.ch8", "Tetris.ch8", "OpcodeTest.ch8" };
+	struct input_script script = {0};
+	if (config.input && load_input_script(config.input, &script) != 0) { fprintf(stderr, "Running end-to-end benchmarks without input\n"); }
+
+	for (size_t i = 0; i < sizeof(roms) / sizeof(roms[0]); i++)
+	{
+		bench_rom(roms[i], &script, CORE_INTERP);
+#if defined(__x86_64__)
+		bench_rom(roms[i], &script, CORE_JIT);
+#endif
+	}
+	free_input_script(&script);
+}
+
+
+/* disassemble_file() on a temporary archive of every opcode, output to /dev/null */
+static void bench_disassembler(void)
+{
+	char path[] = "/tmp/potatoCHIP8-bench-XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0) { fprintf(stderr, "Skipping disassembler benchmark\n"); return; }
+	uint8_t opcodes[0x20000];
+	for (uint32_t op = 0; op < 0x10000; op++)
+	{
+		opcodes[op * 2] = op >> 8;
+		opcodes[op * 2 + 1] = op & 0xFF;
+	}
+	int ok = 1;
+	for (int i = 0; i < DISAS_COPIES; i++) { ok &= write(fd, opcodes, sizeof(opcodes)) == (ssize_t)sizeof(opcodes); }
+	close(fd);
+
+	int null_fd = open("/dev/null", O_WRONLY);
+	int stdout_fd = dup(STDOUT_FILENO);
+	if (!ok || null_fd < 0 || stdout_fd < 0) { fprintf(stderr, "Skipping disassembler benchmark\n"); unlink(path); return; }
+
+	uint64_t instructions = (uint64_t)DISAS_COPIES * 0x10000;
+	double samples[config.repetitions];
+	fflush(stdout);
+	dup2(null_fd, STDOUT_FILENO);
+	for (int r = -config.warmup; r < config.repetitions; r++)
+	{
+		struct timespec start, stop;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		disassemble_file(path);
+		clock_gettime(CLOCK_MONOTONIC, &stop);
+		if (r >= 0) { samples[r] = elapsed_seconds(&start, &stop) * 1e9 / instructions; }
+	}
+	fflush(stdout);
+	dup2(stdout_fd, STDOUT_FILENO);
+	close(stdout_fd);
+	close(null_fd);
+	unlink(path);
+
+	struct stats stats;
+	summarize(samples, config.repetitions, &stats);
+	char detail[64];
+	snprintf(detail, sizeof(detail), "\"megabytes_per_second\": %.1f", 2 * 1e3 / stats.median);
+	print_result("disas", "disassemble_file", detail, instructions, 0, &stats);
+}
+
+
+static void argparse(int argc, char **argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 < argc && strcmp(argv[i], "--warmup") == 0) { config.warmup = atoi(argv[++i]); }
+		else if (i + 1 < argc && strcmp(argv[i], "--repetitions") == 0) { config.repetitions = atoi(argv[++i]); }
+		else if (i + 1 < argc && strcmp(argv[i], "--roms") == 0) { config.rom_dir = argv[++i]; }
+		else if (i + 1 < argc && strcmp(argv[i], "--input") == 0) { config.input = argv[++i]; }
+		else
+		{
+			fprintf(stderr, "Usage: %s [--warmup N] [--repetitions N] [--roms DIR] [--input FILE]\n", argv[0]);
+			exit(-1);
+		}
+	}
+	if (config.warmup < 0) { config.warmup = 0; }
+	if (config.repetitions < 1) { config.repetitions = 1; }
+}
+
+
+int main(int argc, char **argv)
+{
+	argparse(argc, argv);
+
+	printf("{\n  \"version\": 1,\n  \"core\": \"%s\",\n  \"warmup\": %d,\n  \"repetitions\": %d,\n  \"results\": [",
+		CORE_NAME, config.warmup, config.repetitions);
+	bench_handlers();
+	bench_draw();
+	bench_roms();
+	bench_disassembler();
+	printf("\n  ]\n}\n");
+	return 0;
+}
@@ -0,0 +1,34 @@
+#!/bin/sh
+#
+# PotatoCHIP-8 - Benchmark comparison
+#
+# Usage: bench/compare.sh BASELINE.json CANDIDATE.json
+#
+# Prints the median ns/instruction (ns/frame for end-to-end runs)
+# of every benchmark in both result files (from potatoCHIP8-bench) and the speedup of the
+# candidate, then the geometric mean speedup per group.
+
+if [ $# -ne 2 ]; then
+	echo "Usage: $0 BASELINE.json CANDIDATE.json" >&2
+	exit 1
+fi
+
+awk '
+function field(line, key) {
+	if (!match(line, "\"" key "\": \"[^\"]*\"")) { return "" }
+	return substr(line, RSTART + length(key) + 5, RLENGTH - length(key) - 6)
+}
+/"group":/ {
+	name = field($0, "name")
+	median = substr($0, index($0, "\"median\": ") + 10) + 0
+	if (FILENAME == ARGV[1]) { baseline[name] = median; next }
+	if (!(name in baseline)) { next }
+	group = field($0, "group")
+	speedup = baseline[name] / median
+	printf "%-8s %-32s %9.3f -> %9.3f ns  %6.2fx\n", group, name, baseline[name], median, speedup
+	logs[group] += log(speedup); counts[group]++
+	logs["all"] += log(speedup); counts["all"]++
+}
+END {
+	for (group in counts) { printf "Geometric mean speedup (%s): %.2fx\n", group, exp(logs[group] / counts[group]) }
+}' "$1" "$2"
@@ -0,0 +1,389 @@
+/*
+* PotatoCHIP-8 - ROM Corpus Analyzer
+*
+* Static triage of every .ch8 under a directory. Files are
+* mmap'd and analyzed on worker threads; each one gets a JSON
+* line with its size, content hash, opcode histogram, unknown
+* opcodes, self-modifying stores and extension opcodes.
+*
+* Code is found by recursive traversal from 0x200 (following
+* jumps, calls and both sides of skips) instead of a linear
+* sweep, so sprite/data bytes don't show up as unknown
+* opcodes. I is tracked through each straight-line run (Annn,
+* Fx1E, XO-CHIP F000 nnnn) to resolve Fx55/Fx33 store targets;
+* a store whose target overlaps reached code is self-modifying.
+*/
+
+
+#define _XOPEN_SOURCE 700 // nftw()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <ftw.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "chip8.h" // TOTAL_RAM, RAM_RESERVED_SIZE, decode_op(), handler_name()
+#include "debugger.h" // known_instruction()
+#include "headless.h" // state_hash(), elapsed_seconds()
+#include "profile.h" // PROFILE_HANDLER_SLOTS
+#include "analyze.h"
+
+
+#define MAX_LISTED 64 // Unknown opcodes/self-modifying stores listed per ROM (all are counted)
+#define I_UNKNOWN -1
+
+enum extension{
+	EXT_NONE = 0,
+	EXT_SUPERCHIP,
+	EXT_XOCHIP,
+};
+
+struct store{
+	uint16_t address; // Fx55/Fx33 instruction
+	uint16_t target;  // I at that point
+	uint16_t length;  // Bytes written
+};
+
+/* Per-ROM analysis state (one per worker, reused) */
+struct rom_analysis{
+	uint8_t ram[TOTAL_RAM];
+	uint32_t end;                 // End of the loaded ROM, code isn't followed past it (or into the reserved area)
+	uint8_t code[TOTAL_RAM];      // 1 = byte belongs to a reached instruction
+	uint8_t visited[TOTAL_RAM];   // 1 = instruction decoded at this address
+	uint16_t worklist[TOTAL_RAM];
+	size_t pending;
+	struct store stores[TOTAL_RAM / 2];
+	size_t store_count;
+	uint64_t histogram[PROFILE_HANDLER_SLOTS];
+	uint64_t instructions;
+	uint64_t unresolved_stores;
+	uint64_t extension_count[3];
+	uint16_t unknown[MAX_LISTED][2]; // address, opcode
+	uint64_t unknown_count;
+};
+
+struct analyzer{
+	char **paths;
+	size_t count;
+	char **results; // JSON line per path, filled by workers
+	size_t next;    // Next path to take (atomic)
+	size_t failed;  // Paths that couldn't be read (atomic)
+	uint64_t bytes; // Total ROM bytes mapped (atomic)
+};
+
+
+/* Extension instruction set an opcode belongs to (patterns that are unused/no-ops in plain CHIP-8) */
+static enum extension extension_of(uint16_t opcode)
+{
+	uint8_t low = opcode & 0xFF;
+	switch (opcode >> 12) {
+		case 0x0:
+			if ((opcode & 0xFFF0) == 0x00C0 && (opcode & 0xF)) { return EXT_SUPERCHIP; } // SCD n
+			if (opcode >= 0x00FB && opcode <= 0x00FF) { return EXT_SUPERCHIP; } // SCR, SCL, EXIT, LOW, HIGH
+			if ((opcode & 0xFFF0) == 0x00D0) { return EXT_XOCHIP; } // SCU n
+			break;
+		case 0x5:
+			if ((opcode & 0xF) == 2 || (opcode & 0xF) == 3) { return EXT_XOCHIP; } // Save/load Vx..Vy
+			break;
+		case 0xD:
+			if ((opcode & 0xF) == 0) { return EXT_SUPERCHIP; } // 16x16 sprite
+			break;
+		case 0xF:
+			if (opcode == 0xF000 || opcode == 0xF002 || low == 0x01 || low == 0x3A) { return EXT_XOCHIP; } // Long I, audio, plane, pitch
+			if (low == 0x30 || low == 0x75 || low == 0x85) { return EXT_SUPERCHIP; } // Big font, RPL flags
+			break;
+	}
+	return EXT_NONE;
+}
+
+
+static void push(struct rom_analysis *rom, uint32_t address)
+{
+	if (address >= RAM_RESERVED_SIZE && address + 1 < rom->end && !rom->visited[address]) { rom->worklist[rom->pending++] = address; }
+}
+
+/* Follow straight-line code from start until it ends (RET/EXIT/JP/unknown) or rejoins visited code */
+static void walk(struct rom_analysis *rom, uint16_t start)
+{
+	int32_t index = I_UNKNOWN;
+	uint32_t address = start;
+
+	while (address + 1 < rom->end && !rom->visited[address])
+	{
+		uint16_t opcode = rom->ram[address] << 8 | rom->ram[address + 1];
+		uint32_t next = address + 2;
+		uint8_t x = (opcode >> 8) & 0xF;
+		rom->visited[address] = 1;
+		rom->code[address] = rom->code[address + 1] = 1;
+		rom->instructions++;
+
+		struct chip8_op op;
+		decode_op(&op, opcode);
+		rom->histogram[op.handler]++;
+
+		enum extension extension = extension_of(opcode);
+		rom->extension_count[extension]++;
+		if (extension == EXT_NONE && !known_instruction(opcode))
+		{
+			if (rom->unknown_count < MAX_LISTED)
+			{
+				rom->unknown[rom->unknown_count][0] = address;
+				rom->unknown[rom->unknown_count][1] = opcode;
+			}
+			rom->unknown_count++;
+			return; // Most likely data
+		}
+
+		switch (opcode >> 12) {
+			case 0x0:
+				if (opcode == 0x00EE || opcode == 0x00FD) { return; } // RET, SUPER-CHIP EXIT
+				break;
+			case 0x1:
+				push(rom, opcode & 0xFFF);
+				return;
+			case 0x2:
+				push(rom, opcode & 0xFFF);
+				break;
+			case 0x3: case 0x4: case 0x9: case 0xE:
+				push(rom, next + 2);
+				break;
+			case 0x5:
+				if ((opcode & 0xF) == 0) { push(rom, next + 2); }
+				break;
+			case 0xA:
+				index = opcode & 0xFFF;
+				break;
+			case 0xB:
+				return; // Target depends on V0
+			case 0xF:
+				if (opcode == 0xF000 && next + 1 < rom->end) // XO-CHIP: I = next word
+				{
+					index = rom->ram[next] << 8 | rom->ram[next + 1];
+					rom->code[next] = rom->code[next + 1] = 1;
+					next += 2;
+				}
+				else if ((opcode & 0xFF) == 0x1E) { index = I_UNKNOWN; }
+				else if ((opcode & 0xFF) == 0x55 || (opcode & 0xFF) == 0x33)
+				{
+					if (index == I_UNKNOWN) { rom->unresolved_stores++; break; }
+					struct store *store = &rom->stores[rom->store_count++];
+					store->address = address;
+					store->target = index;
+					store->length = ((opcode & 0xFF) == 0x33) ? 3 : x + 1;
+				}
+				break;
+		}
+		address = next;
+	}
+}
+
+
+/* Append s to out as a JSON string */
+static void print_json_string(FILE *out, const char *s)
+{
+	fputc('"', out);
+	for (; *s; s++)
+	{
+		if (*s == '"' || *s == '\\') { fprintf(out, "\\%c", *s); }
+		else if ((unsigned char)*s < 0x20) { fprintf(out, "\\u%04x", *s); }
+		else { fputc(*s, out); }
+	}
+	fputc('"', out);
+}
+
+/* Analyze one mapped ROM and print its JSON line into out */
+static void analyze_rom(struct rom_analysis *rom, const uint8_t *data, size_t size, FILE *out)
+{
+	memset(rom, 0, sizeof(struct rom_analysis));
+	size_t loaded = (size < TOTAL_RAM - RAM_RESERVED_SIZE) ? size : TOTAL_RAM - RAM_RESERVED_SIZE;
+	memcpy(rom->ram + RAM_RESERVED_SIZE, data, loaded);
+	rom->end = RAM_RESERVED_SIZE + loaded;
+
+	push(rom, RAM_RESERVED_SIZE);
+	while (rom->pending) { walk(rom, rom->worklist[--rom->pending]); }
+
+	fprintf(out, ", \"size\": %zu, \"fits\": %s, \"hash\": \"%016llx\", \"instructions\": %llu",
+		size, (size == loaded) ? "true" : "false", (unsigned long long)state_hash(0, data, size), (unsigned long long)rom->instructions);
+
+	fprintf(out, ", \"histogram\": {");
+	for (int h = 0, first = 1; h < PROFILE_HANDLER_SLOTS; h++)
+	{
+		if (rom->histogram[h] == 0) { continue; }
+		fprintf(out, "%s\"%s\": %llu", first ? "" : ", ", handler_name(h), (unsigned long long)rom->histogram[h]);
+		first = 0;
+	}
+
+	fprintf(out, "}, \"unknown_count\": %llu, \"unknown\": [", (unsigned long long)rom->unknown_count);
+	for (uint64_t i = 0; i < rom->unknown_count && i < MAX_LISTED; i++)
+	{
+		fprintf(out, "%s{\"address\": \"0x%03X\", \"opcode\": \"0x%04X\"}", i ? ", " : "", rom->unknown[i][0], rom->unknown[i][1]);
+	}
+
+	uint64_t self_modifying = 0;
+	fprintf(out, "], \"self_modifying\": [");
+	for (size_t i = 0; i < rom->store_count; i++)
+	{
+		const struct store *store = &rom->stores[i];
+		int hits_code = 0;
+		for (uint32_t b = store->target; b < (uint32_t)store->target + store->length && b < TOTAL_RAM; b++) { hits_code |= rom->code[b]; }
+		if (!hits_code) { continue; }
+		if (self_modifying < MAX_LISTED)
+		{
+			fprintf(out, "%s{\"address\": \"0x%03X\", \"target\": \"0x%03X\", \"length\": %u}", self_modifying ? ", " : "", store->address, store->target, store->length);
+		}
+		self_modifying++;
+	}
+	fprintf(out, "], \"self_modifying_count\": %llu, \"unresolved_stores\": %llu, \"superchip\": %llu, \"xochip\": %llu}",
+		(unsigned long long)self_modifying, (unsigned long long)rom->unresolved_stores,
+		(unsigned long long)rom->extension_count[EXT_SUPERCHIP], (unsigned long long)rom->extension_count[EXT_XOCHIP]);
+}
+
+
+/* mmap path and analyze it, returns malloc'd JSON line (without newline) */
+static char *analyze_file(struct analyzer *analyzer, struct rom_analysis *rom, const char *path)
+{
+	char *line = NULL;
+	size_t length = 0;
+	FILE *out = open_memstream(&line, &length);
+	if (out == NULL) { return NULL; }
+
+	fprintf(out, "{\"path\": ");
+	print_json_string(out, path);
+
+	const char *error = NULL;
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) { error = "cannot open"; }
+	else if (st.st_size == 0) { error = "empty"; }
+	else
+	{
+		const uint8_t *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) { error = "cannot map"; }
+		else
+		{
+			analyze_rom(rom, data, st.st_size, out);
+			__atomic_fetch_add(&analyzer->bytes, (uint64_t)st.st_size, __ATOMIC_RELAXED);
+			munmap((void *)data, st.st_size);
+		}
+	}
+	if (fd >= 0) { close(fd); }
+	if (error)
+	{
+		fprintf(out, ", \"error\": \"%s\"}", error);
+		__atomic_fetch_add(&analyzer->failed, 1, __ATOMIC_RELAXED);
+	}
+
+	fclose(out);
+	return line;
+}
+
+
+/* Worker: take paths by index until none are left (jobs are small and even, so one shared counter is enough) */
+static void *analyzer_main(void *arg)
+{
+	struct analyzer *analyzer = arg;
+	struct rom_analysis *rom = malloc(sizeof(struct rom_analysis));
+	if (rom == NULL) { return NULL; }
+
+	size_t i;
+	while ((i = __atomic_fetch_add(&analyzer->next, 1, __ATOMIC_RELAXED)) < analyzer->count)
+	{
+		analyzer->results[i] = analyze_file(analyzer, rom, analyzer->paths[i]);
+	}
+	free(rom);
+	return NULL;
+}
+
+
+static char **found_paths; // nftw() has no context argument
+static size_t found_count;
+static size_t found_capacity;
+
+/* Collect regular files ending in .ch8 (case-insensitive) */
+static int collect_rom(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+	(void)st; (void)ftw;
+	size_t length = strlen(path);
+	if (type != FTW_F || length < 4 || strcasecmp(path + length - 4, ".ch8") != 0) { return 0; }
+
+	if (found_count == found_capacity)
+	{
+		found_capacity = found_capacity ? found_capacity * 2 : 256;
+		char **grown = realloc(found_paths, found_capacity * sizeof(char *));
+		if (grown == NULL) { return -1; }
+		found_paths = grown;
+	}
+	found_paths[found_count] = strdup(path);
+	return (found_paths[found_count++] == NULL) ? -1 : 0;
+}
+
+static int by_path(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+
+/* Analyze every .ch8 under dir on worker threads, print one JSON line per ROM (sorted by path)
+* - threads <= 0 uses one worker per online CPU
+* - Totals and throughput go to stderr, so stdout stays valid JSON lines
+*/
+int analyze_corpus(const char *dir, int threads)
+{
+	if (threads <= 0) { threads = (int)sysconf(_SC_NPROCESSORS_ONLN); }
+	if (threads <= 0) { threads = 1; }
+	initialize_decoder(); // Before workers call decode_op()
+
+	struct timespec start, stop;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	int status = -1;
+	found_paths = NULL;
+	found_count = found_capacity = 0;
+	if (nftw(dir, collect_rom, 64, FTW_PHYS) != 0) { printf("Error reading directory '%s'\n", dir); goto out; }
+	if (found_count == 0) { printf("No .ch8 files under '%s'\n", dir); goto out; }
+	qsort(found_paths, found_count, sizeof(char *), by_path);
+
+	struct analyzer analyzer = { .paths = found_paths, .count = found_count };
+	analyzer.results = calloc(found_count, sizeof(char *));
+	pthread_t *workers = calloc(threads, sizeof(pthread_t));
+	if (analyzer.results == NULL || workers == NULL) { puts("Error allocating analyzer."); free(analyzer.results); free(workers); goto out; }
+
+	int started = 0;
+	for (; started < threads; started++)
+	{
+		if (pthread_create(&workers[started], NULL, analyzer_main, &analyzer) != 0) { break; }
+	}
+	if (started == 0) { analyzer_main(&analyzer); } // Couldn't spawn threads, analyze inline
+	for (int t = 0; t < started; t++) { pthread_join(workers[t], NULL); }
+
+	for (size_t i = 0; i < found_count; i++)
+	{
+		if (analyzer.results[i] == NULL) { analyzer.failed++; continue; }
+		puts(analyzer.results[i]);
+		free(analyzer.results[i]);
+	}
+	fflush(stdout);
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	double seconds = elapsed_seconds(&start, &stop);
+	fprintf(stderr, "Analyzed %zu ROMs (%zu failed), %llu bytes on %d threads in %.3f s (%.0f ROMs/s, %.1f MB/s)\n",
+		found_count, analyzer.failed, (unsigned long long)analyzer.bytes, threads, seconds,
+		seconds > 0 ? found_count / seconds : 0.0, seconds > 0 ? analyzer.bytes / seconds / 1e6 : 0.0);
+	free(analyzer.results);
+	free(workers);
+	status = 0;
+
+out:
+	for (size_t i = 0; i < found_count; i++) { free(found_paths[i]); }
+	free(found_paths);
+	found_paths = NULL;
+	return status;
+}
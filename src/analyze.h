@@ -0,0 +1,17 @@
+/*
+* PotatoCHIP-8 - ROM Corpus Analyzer Header
+*
+* Parallel static analysis of a directory of ROMs
+*/
+
+/* PUBLIC FUNCTIONS
+   - analyze_corpus()
+*/
+
+#ifndef POTATOCHIP_ANALYZE
+#define POTATOCHIP_ANALYZE
+
+/* Analyze every .ch8 under dir on worker threads (threads <= 0: one per CPU), print one JSON line per ROM */
+int analyze_corpus(const char *dir, int threads);
+
+#endif // POTATOCHIP_ANALYZE
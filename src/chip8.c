@@ -10,8 +10,13 @@
 #include <stdint.h>
 #include <string.h>
 #include <time.h>
-#include <SDL2/SDL.h>
-#include "chip8.h" /* Chip8Memory *MEMORY, TOTAL_RAM, STACK_SIZE */
+#include <pthread.h>
+#include "chip8.h" /* struct Chip8Memory, TOTAL_RAM, STACK_SIZE */
+#include "jit.h" /* jit_invalidate() */
+#include "profile.h" /* struct chip8_profile */
+#include "debugger.h" /* struct chip8_debug */
+#include "history.h" /* history_record() */
+#include "trace.h" /* trace_record() */
 
 #define START_ADDRESS 512 // Address of first instruction is expected
 #define FONTSET_START 0
@@ -38,53 +43,68 @@ uint8_t fontset[FONTSET_SIZE] =
 };
 
 
-/* Allocate and initialize MEMORY structure pointer.
-* - Allocating all memory-related structures to the heap to avoid stack/ptr issues
-* - RAM and registers all inside global MEMORY struct, for convenience
+/* Initialize caller-allocated machine (stack, heap, or pool storage)
+* - Zeroes RAM, registers, stack, screen, and keypad
+* - Loads fontset into the reserved interpreter area
+* - Seeds RAND from the clock and machine address, call seed_rng() for reproducible runs
 */
-int initialize_memory()
+int initialize_memory(struct Chip8Memory *machine)
 {
-	/* Allocate MEMORY (declared in chip8.h), set ram and registers pointers */
-	MEMORY = malloc(sizeof(struct Chip8Memory));
-	if (MEMORY == NULL)
+	if (machine == NULL)
 	{
-		puts("Error allocating memory structure.");
+		puts("Error: no machine to initialize.");
 		return -1;
 	}
 
-	/* Allocate and zero ram, registers, etc. */
-	memset(MEMORY->ram, 0, TOTAL_RAM);
-	memset(MEMORY->registers, 0, sizeof(MEMORY->registers));
-	memset(MEMORY->stack, 0, sizeof(MEMORY->stack));
-	memset(MEMORY->screen, 0, sizeof(MEMORY->screen));
-	memset(MEMORY->keypad, 0, sizeof(MEMORY->keypad));
-	MEMORY->delay_timer = 0;
-	MEMORY->sound_timer = 0;
-	MEMORY->index = 0;
-	MEMORY->pc = START_ADDRESS; // Set Program Counter to first instruction of data
-	MEMORY->sp = STACK_SIZE - 1; // Set stack pointer to top of the stack (Last element)
+	/* Zero ram, registers, etc. (padding too, so save_state() writes the same bytes for the same state) */
+	memset(machine, 0, MACHINE_STATE_SIZE);
+	machine->dirty_rows = 0xFFFFFFFF; // Present the blank screen once
+	machine->skipped = 0;
+	machine->keypad = 0;
+	machine->key_wait = 0;
+	memset(machine->decoded, UNDECODED, sizeof(machine->decoded));
+	machine->jit = NULL; // Attach with jit_attach() after initializing
+	machine->profile = NULL; // Attach a profile_create() profile after initializing
+	machine->debug = NULL; // Attached by cmd_debug()
+	machine->trace = NULL; // Attach a trace_open() trace after initializing
+	machine->delay_timer = 0;
+	machine->sound_timer = 0;
+	machine->index = 0;
+	machine->ir = 0;
+	machine->pc = START_ADDRESS; // Set Program Counter to first instruction of data
+	machine->sp = STACK_SIZE - 1; // Set stack pointer to top of the stack (Last element)
 
 	/* Load fontset into reserved area */
 	for (uint8_t i = 0; i < FONTSET_SIZE; ++i)
 	{
-		MEMORY->ram[FONTSET_START + i] = fontset[i];
+		machine->ram[FONTSET_START + i] = fontset[i];
 	}
 
-	time_t t;
-	srand((unsigned) time(&t)); // Intialize RNG
+	seed_rng(machine, (uint64_t)time(NULL) ^ (uint64_t)(uintptr_t)machine); // Intialize RNG
+
+	initialize_decoder();
 
 	return 0;
 }
 
 
-/* Free global MEMORY struct, registers, and RAM, set pointers to zero */
-void release_memory()
+/* Drop predecoded entries overlapping [address, address + length) after RAM is written
+* - Entry n caches the instruction at 2n, so a write to byte b stales entry b / 2
+* - Only called by loaders and the RAM-writing opcodes (Fx33, Fx55)
+* - Also drops JIT blocks translated from that range, if a JIT is attached
+*/
+void invalidate_decoded(struct Chip8Memory *machine, uint32_t address, uint32_t length)
 {
-	if (MEMORY != 0)
+	if (length == 0 || address >= TOTAL_RAM) { return; }
+	uint32_t last = address + length - 1;
+	if (last >= TOTAL_RAM) { last = TOTAL_RAM - 1; }
+
+	for (uint32_t entry = address >> 1; entry <= (last >> 1); entry++)
 	{
-		free(MEMORY);
-		MEMORY = 0;
-	}	
+		machine->decoded[entry].handler = UNDECODED;
+	}
+
+	if (machine->jit) { jit_invalidate(machine->jit, address, last - address + 1); }
 }
 
 
@@ -95,246 +115,682 @@ void release_memory()
 /*** Flow Control ***/
 
 // 0x2nnn - Call subroutine (Push current PC to stack, then set to new address)
-static void CALL() 
+static void CALL(struct Chip8Memory *m, const struct chip8_op *op) 
 { 
-	MEMORY->stack[MEMORY->sp] = MEMORY->pc;
-	MEMORY->sp -= 1; // Cuz the stack grows towards 0
-	MEMORY->pc = (MEMORY->ir & 0xFFF); 
+	m->stack[m->sp] = m->pc;
+	m->sp -= 1; // Cuz the stack grows towards 0
+	m->pc = op->nnn; 
 }
 
 // 0x00EE - Return from subroutine (Pop last address off stack and set PC to it)
-static void RET() 
+static void RET(struct Chip8Memory *m, const struct chip8_op *op) 
 { 
-	MEMORY->sp += 1;
-	MEMORY->pc = MEMORY->stack[MEMORY->sp]; 
+	m->sp += 1;
+	m->pc = m->stack[m->sp]; 
 } 
 
 // 0x1nnn - Jump to address
-static void JMP() { MEMORY->pc = (MEMORY->ir & 0xFFF); }
+static void JMP(struct Chip8Memory *m, const struct chip8_op *op) { m->pc = op->nnn; }
 
 // 0xBnnn - Jump to address + V0
-static void JMP_OFFSET() { MEMORY->pc = ((MEMORY->ir & 0xFFF) + MEMORY->registers[0]); }
+static void JMP_OFFSET(struct Chip8Memory *m, const struct chip8_op *op) { m->pc = (op->nnn + m->registers[0]); }
 
 // 0x3xkk  - Skip next instruction if equal
-static void SKIP_EQ() 
+static void SKIP_EQ(struct Chip8Memory *m, const struct chip8_op *op) 
 {
-	if (MEMORY->registers[(MEMORY->ir >> 8) & 0xF] == (MEMORY->ir & 0xFF)) { MEMORY->pc += 2; }
+	if (m->registers[op->x] == op->kk) { m->pc += 2; }
 }
 
 // 0x5xy0 - Skip next instruction if equal (registers)
-static void SKIP_EQ_R()
+static void SKIP_EQ_R(struct Chip8Memory *m, const struct chip8_op *op)
 {
-	if (MEMORY->registers[(MEMORY->ir >> 8) & 0xF] == MEMORY->registers[(MEMORY->ir >> 4) & 0xF]) { MEMORY->pc += 2; }
+	if (m->registers[op->x] == m->registers[op->y]) { m->pc += 2; }
 }
 
 // 0x4xkk - Skip next instruction if not equal
-static void SKIP_N_EQ() 
+static void SKIP_N_EQ(struct Chip8Memory *m, const struct chip8_op *op) 
 {
-	if (MEMORY->registers[(MEMORY->ir >> 8) & 0xF] != (MEMORY->ir & 0xFF)) { MEMORY->pc += 2; }
+	if (m->registers[op->x] != op->kk) { m->pc += 2; }
 }
 
 // 0x9xy0 - Skip next instruction if not equal (registers)
-static void SKIP_N_EQ_R()
+static void SKIP_N_EQ_R(struct Chip8Memory *m, const struct chip8_op *op)
 {
-	if (MEMORY->registers[(MEMORY->ir >> 8) & 0xF] != MEMORY->registers[(MEMORY->ir >> 4) & 0xF]) { MEMORY->pc += 2; }
+	if (m->registers[op->x] != m->registers[op->y]) { m->pc += 2; }
 }
 
 // 0xEx9E - Skip next instruction if key is pressed
-static void SKIP_KEY() { if (MEMORY->keypad[(MEMORY->ir >> 8) & 0xF]) { MEMORY->pc += 2; } }
+static void SKIP_KEY(struct Chip8Memory *m, const struct chip8_op *op) { if (m->keypad & (1u << op->x)) { m->pc += 2; } }
 
 // 0xExA1 - Skip next instruction if key is not pressed
-static void SKIP_N_KEY() { if (!MEMORY->keypad[(MEMORY->ir >> 8) & 0xF]) { MEMORY->pc += 2; } }
+static void SKIP_N_KEY(struct Chip8Memory *m, const struct chip8_op *op) { if (!(m->keypad & (1u << op->x))) { m->pc += 2; } }
 
 // 0xFx0A - Stop execution until key is pressed
-static void WAIT_KEY() 
+static void WAIT_KEY(struct Chip8Memory *m, const struct chip8_op *op) 
 { /* Vx = key_value */ 
-	for (uint8_t i = 0; i <= 0xF; i++)
-	{
-		if (MEMORY->keypad[i]) { MEMORY->registers[(MEMORY->ir >> 8) & 0xF] = i; return; }
-	}
-	MEMORY->pc -= 2;
+	if (m->keypad) { m->registers[op->x] = __builtin_ctz(m->keypad); return; } // Lowest held key
+	m->key_wait = 0x10 | op->x; // Parked until set_key() presses a key
 }
 
 // 0x0000, 0x0nnn
-static void NOOP() { /* no-op */ } 
+static void NOOP(struct Chip8Memory *m, const struct chip8_op *op) { /* no-op */ } 
 
 
 /*** Memory ***/
 
 // 0x6xkk - Load/set register to kk
-static void LD_BYTE() { MEMORY->registers[(MEMORY->ir >> 8) & 0xF] = (MEMORY->ir & 0xFF); }
+static void LD_BYTE(struct Chip8Memory *m, const struct chip8_op *op) { m->registers[op->x] = op->kk; }
 
 // 0x8xy0
-static void LD_R() { MEMORY->registers[(MEMORY->ir >> 8) & 0xF] = MEMORY->registers[(MEMORY->ir >> 4) & 0xF]; }
+static void LD_R(struct Chip8Memory *m, const struct chip8_op *op) { m->registers[op->x] = m->registers[op->y]; }
 
 // 0xFx07 - Load delay timer value into Vx
-static void LD_DT() { MEMORY->registers[(MEMORY->ir >> 8) & 0xF] = MEMORY->delay_timer; }
+static void LD_DT(struct Chip8Memory *m, const struct chip8_op *op) { m->registers[op->x] = m->delay_timer; }
 
 // 0xAnnn - Set I(ndex) register to nnn
-static void SET_INDEX() { MEMORY->index = (MEMORY->ir & 0xFFF); }
+static void SET_INDEX(struct Chip8Memory *m, const struct chip8_op *op) { m->index = op->nnn; }
 
 // 0xFx15 - Delay timer is set to Vx
-static void SET_DT() { MEMORY->delay_timer = MEMORY->registers[(MEMORY->ir >> 8) & 0xF]; }
+static void SET_DT(struct Chip8Memory *m, const struct chip8_op *op) { m->delay_timer = m->registers[op->x]; }
 
 // 0xFx18 - Sound timer is set to Vx
-static void SET_ST() { MEMORY->sound_timer = MEMORY->registers[(MEMORY->ir >> 8) & 0xF]; }
+static void SET_ST(struct Chip8Memory *m, const struct chip8_op *op) { m->sound_timer = m->registers[op->x]; }
 
 // 0xFx29 - Load location of hexadecimal sprite corresponding to x into I
-static void LOAD_SPRITE() { MEMORY->index = FONTSET_START + (5 * (MEMORY->ir >> 8) & 0xF); }
+static void LOAD_SPRITE(struct Chip8Memory *m, const struct chip8_op *op) { m->index = FONTSET_START + (5 * (op->opcode >> 8) & 0xF); }
 
 // 0xFx55 - Store registers in memory (Copies values from V0-Vx into memory, starting at I)
-static void STORE_REGISTERS() 
+static void STORE_REGISTERS(struct Chip8Memory *m, const struct chip8_op *op) 
 { 
-	for (uint8_t i = 0; i <= ((MEMORY->ir >> 8) & 0xF); i++)
+	for (uint8_t i = 0; i <= op->x; i++)
 	{
-		MEMORY->ram[MEMORY->index + i] = MEMORY->registers[i];
+		m->ram[m->index + i] = m->registers[i];
 	}
+	invalidate_decoded(m, m->index, op->x + 1);
 }
 
 // 0xFx65 - Load values from memory into registers (I into V0-Vx)
-static void LOAD_REGISTERS() 
+static void LOAD_REGISTERS(struct Chip8Memory *m, const struct chip8_op *op) 
 {
-	for (uint8_t i = 0; i <= ((MEMORY->ir >> 8) & 0xF); i++)
+	for (uint8_t i = 0; i <= op->x; i++)
 	{
-		MEMORY->registers[i] = MEMORY->ram[MEMORY->index + i];
+		m->registers[i] = m->ram[m->index + i];
 	}
 }
 
 // 0xFx33 - Store BCD representation of Vx in memory locations I, I+1, and I+2
-static void STORE_BCD() 
+static void STORE_BCD(struct Chip8Memory *m, const struct chip8_op *op) 
 {
-	uint8_t value = (MEMORY->ir >> 8) & 0xF;
-	MEMORY->ram[MEMORY->index + 2] = value % 10;
+	uint8_t value = op->x;
+	m->ram[m->index + 2] = value % 10;
 	value /= 10;
-	MEMORY->ram[MEMORY->index + 1] = value % 10;
+	m->ram[m->index + 1] = value % 10;
 	value /= 10;
-	MEMORY->ram[MEMORY->index] = value % 10;
+	m->ram[m->index] = value % 10;
+	invalidate_decoded(m, m->index, 3);
 }
 
 
 /*** Arithmetic ***/
 
+/* Next byte from the machine's xorshift64* generator (top bits, the best mixed) */
+static inline uint8_t random_byte(struct Chip8Memory *m)
+{
+	uint64_t x = m->rng;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	m->rng = x;
+	return (uint8_t)((x * 0x2545F4914F6CDD1Dull) >> 56);
+}
+
 // 0xCxkk - Random number (0-255) & kk
-static void RAND() { MEMORY->registers[(MEMORY->ir >> 8) & 0xF] = ((MEMORY->ir & 0xFF) & (uint8_t)rand()); }
+static void RAND(struct Chip8Memory *m, const struct chip8_op *op) { m->registers[op->x] = (op->kk & random_byte(m)); }
 
 // 0x7xkk - Add (VF (carry) flag not affected)
-static void ADD() { MEMORY->registers[(MEMORY->ir >> 8) & 0xF] += (MEMORY->ir & 0xFF); }
+static void ADD(struct Chip8Memory *m, const struct chip8_op *op) { m->registers[op->x] += op->kk; }
 
 // 0xFx1E - ADD (Index)
-static void I_ADD() { MEMORY->index += MEMORY->registers[(MEMORY->ir >> 8) & 0xF]; }
+static void I_ADD(struct Chip8Memory *m, const struct chip8_op *op) { m->index += m->registers[op->x]; }
 
 // 0x8xy4 - Bitwise ADD (Carry stored in VF)
-static void BIT_ADD() 
+static void BIT_ADD(struct Chip8Memory *m, const struct chip8_op *op) 
 {
-	uint16_t sum = MEMORY->registers[(MEMORY->ir >> 8) & 0xF] + MEMORY->registers[(MEMORY->ir >> 4) & 0xF];
-	MEMORY->registers[(MEMORY->ir >> 8) & 0xF] = (sum & 0xFF);
-	MEMORY->registers[0xF] = (sum >> 8) ? 0x01 : 0x00;
+	uint16_t sum = m->registers[op->x] + m->registers[op->y];
+	m->registers[op->x] = (sum & 0xFF);
+	m->registers[0xF] = (sum >> 8) ? 0x01 : 0x00;
 }
 
 // 0x8xy1 - Bitwise OR
-static void BIT_OR() { MEMORY->registers[(MEMORY->ir >> 8) & 0xF] |= MEMORY->registers[(MEMORY->ir >> 4) & 0xF]; }
+static void BIT_OR(struct Chip8Memory *m, const struct chip8_op *op) { m->registers[op->x] |= m->registers[op->y]; }
 
 // 0x8xy2 - Bitwise AND
-static void BIT_AND() { MEMORY->registers[(MEMORY->ir >> 8) & 0xF] &= MEMORY->registers[(MEMORY->ir >> 4) & 0xF]; }
+static void BIT_AND(struct Chip8Memory *m, const struct chip8_op *op) { m->registers[op->x] &= m->registers[op->y]; }
 
 // 0x8xy3 - Bitwise XOR
-static void BIT_XOR() { MEMORY->registers[(MEMORY->ir >> 8) & 0xF] ^= MEMORY->registers[(MEMORY->ir >> 4) & 0xF]; }
+static void BIT_XOR(struct Chip8Memory *m, const struct chip8_op *op) { m->registers[op->x] ^= m->registers[op->y]; }
 
 // 0x8xy5 - Bitwise SUB (If Vx > Vy, then VF is set to 1, otherwise 0)
-static void BIT_SUB()
+static void BIT_SUB(struct Chip8Memory *m, const struct chip8_op *op)
 {
-	MEMORY->registers[0xF] = (MEMORY->registers[(MEMORY->ir >> 8) & 0xF] > MEMORY->registers[(MEMORY->ir >> 4) & 0xF]) ? 0x01 : 0x00;
-	MEMORY->registers[(MEMORY->ir >> 8) & 0xF] -= MEMORY->registers[(MEMORY->ir >> 4) & 0xF];
+	m->registers[0xF] = (m->registers[op->x] > m->registers[op->y]) ? 0x01 : 0x00;
+	m->registers[op->x] -= m->registers[op->y];
 }
 
 // 0x8xy6 - Bitwise SHR (Divide Vx by 2)
-static void BIT_SHR() 
+static void BIT_SHR(struct Chip8Memory *m, const struct chip8_op *op) 
 { /* Store LSB in VF, Vx >>= 1 (if y != 0, Vx = Vy first) */ 
-	MEMORY->registers[0xF] = MEMORY->registers[(MEMORY->ir >> 8) & 0xF] & 0x1u;
-	MEMORY->registers[(MEMORY->ir >> 8) & 0xF] >>= 1;
+	m->registers[0xF] = m->registers[op->x] & 0x1u;
+	m->registers[op->x] >>= 1;
 }
 
 // 0x8xy7 - Bitwise SUBN If Vy > Vx, then VF is set to 1, otherwise 0
-static void BIT_SUBN()
+static void BIT_SUBN(struct Chip8Memory *m, const struct chip8_op *op)
 {
-	MEMORY->registers[0xF] = (MEMORY->registers[(MEMORY->ir >> 4) & 0xF] > MEMORY->registers[(MEMORY->ir >> 8) & 0xF]) ? 0x01 : 0x00;
-	MEMORY->registers[(MEMORY->ir >> 8) & 0xF] = MEMORY->registers[(MEMORY->ir >> 4) & 0xF] - MEMORY->registers[(MEMORY->ir >> 8) & 0xF];
+	m->registers[0xF] = (m->registers[op->y] > m->registers[op->x]) ? 0x01 : 0x00;
+	m->registers[op->x] = m->registers[op->y] - m->registers[op->x];
 }
 
 // 0x8xyE - Bitwise SHL (Multiply Vx by 2)
-static void BIT_SHL() 
+static void BIT_SHL(struct Chip8Memory *m, const struct chip8_op *op) 
 { /* Store MSB in VF, Vx >>= 1 (if y != 0, Vx = Vy first) */ 
-	MEMORY->registers[0xF] = (MEMORY->registers[(MEMORY->ir >> 8) & 0xF] & 0x80u) >> 7u;
-	MEMORY->registers[(MEMORY->ir >> 8) & 0xF] <<= 1;
+	m->registers[0xF] = (m->registers[op->x] & 0x80u) >> 7u;
+	m->registers[op->x] <<= 1;
 }
 
 
 /*** Display ***/
 
 // 0x00E0 - Clear screen
-static void CLS() { memset(MEMORY->screen, 0, sizeof(MEMORY->screen)); }
+static void CLS(struct Chip8Memory *m, const struct chip8_op *op) 
+{ 
+	memset(m->screen, 0, sizeof(m->screen)); 
+	m->dirty_rows = 0xFFFFFFFF;
+}
 
 // 0xDxyn - Draw n-byte spirit stored in I(ndex) at (Vx, Vy)
-static void DRAW() 
-{
-	uint8_t height = MEMORY->ir & 0x000Fu;
-	uint8_t xPos = MEMORY->registers[(MEMORY->ir >> 8) & 0xF] % SCREEN_WIDTH;
-	uint8_t yPos = MEMORY->registers[(MEMORY->ir >> 4) & 0xF] % SCREEN_HEIGHT;
-	MEMORY->registers[0xF] = 0;
+static void DRAW(struct Chip8Memory *m, const struct chip8_op *op) 
+{ /* Start position wraps, sprite is clipped at the right and bottom edges */
+	uint8_t height = op->kk & 0x0Fu;
+	uint8_t xPos = m->registers[op->x] % SCREEN_WIDTH;
+	uint8_t yPos = m->registers[op->y] % SCREEN_HEIGHT;
+	uint64_t collision = 0;
+
+	if (height > SCREEN_HEIGHT - yPos) { height = SCREEN_HEIGHT - yPos; }
 	for (unsigned int row = 0; row < height; ++row)
 	{
-		uint8_t spriteByte = MEMORY->ram[MEMORY->index + row];
+		// Sprite byte lined up with the screen row (bit 63 = x 0), bits past x 63 shift out
+		uint64_t spriteRow = ((uint64_t)m->ram[m->index + row] << 56) >> xPos;
+		uint64_t *screenRow = &m->screen[yPos + row];
+
+		collision |= *screenRow & spriteRow;
+		*screenRow ^= spriteRow;
+	}
+	if (height) { m->dirty_rows |= (uint32_t)(0xFFFFFFFFull >> (32 - height)) << yPos; }
+	m->registers[0xF] = (collision != 0);
+}
+
+/************
+* Dispatch *
+************/
+
+/* Three interchangeable interpreter cores, selected at build time (see Makefile CORE=):
+* - CHIP8_CORE_NESTED:   original 2-level function-pointer tables (2 indirect calls for 0/8/E/F)
+* - CHIP8_CORE_FLAT:     flat 64K-entry handler index built from the nested tables at startup (1 indirect call)
+* - CHIP8_CORE_THREADED: flat index + computed-goto dispatch loop, handlers inlined (default)
+* The nested tables are the single source of truth for decoding, so every core behaves identically.
+* All cores fetch through the predecode cache (machine->decoded), so operands are extracted once
+* per RAM address rather than once per execution.
+*/
+#if !defined(CHIP8_CORE_NESTED) && !defined(CHIP8_CORE_FLAT) && !defined(CHIP8_CORE_THREADED)
+#define CHIP8_CORE_THREADED
+#endif
+
+static void _0___(struct Chip8Memory *m, const struct chip8_op *op);
+static void _8___(struct Chip8Memory *m, const struct chip8_op *op);
+static void _E___(struct Chip8Memory *m, const struct chip8_op *op);
+static void _F___(struct Chip8Memory *m, const struct chip8_op *op);
 
-		for (unsigned int col = 0; col < 8; ++col)
+static void (*opcode_0[])(struct Chip8Memory *, const struct chip8_op *) = { CLS, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, RET, NOOP };
+
+static void (*opcode_8[])(struct Chip8Memory *, const struct chip8_op *) = { LD_R, BIT_OR, BIT_AND, BIT_XOR, BIT_ADD, BIT_SUB, BIT_SHR, BIT_SUBN, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, BIT_SHL, NOOP };
+
+static void (*opcode_E[])(struct Chip8Memory *, const struct chip8_op *) = {  NOOP, SKIP_N_KEY, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, SKIP_KEY, NOOP };
+
+static void (*opecode_F[256])(struct Chip8Memory *, const struct chip8_op *) = { [0x00 ... 0xFF] = NOOP,
+								 [0x07] = LD_DT, [0x0A] = WAIT_KEY, [0x15] = SET_DT, [0x18] = SET_ST, [0x1E] = I_ADD,
+								 [0x29] = LOAD_SPRITE, [0x33] = STORE_BCD, [0x55] = STORE_REGISTERS, [0x65] = LOAD_REGISTERS };
+
+
+static void (*_exec[])(struct Chip8Memory *, const struct chip8_op *) = {_0___, JMP, CALL, SKIP_EQ, SKIP_N_EQ, SKIP_EQ_R, LD_BYTE, ADD, _8___, SKIP_N_EQ_R, SET_INDEX, JMP_OFFSET, RAND, DRAW, _E___, _F___};
+static void _0___(struct Chip8Memory *m, const struct chip8_op *op) { (*opcode_0[op->opcode & 0x000F])(m, op); }
+static void _8___(struct Chip8Memory *m, const struct chip8_op *op) { (*opcode_8[op->opcode & 0x000F])(m, op); }
+static void _E___(struct Chip8Memory *m, const struct chip8_op *op) { (*opcode_E[op->opcode & 0x000F])(m, op); }
+static void _F___(struct Chip8Memory *m, const struct chip8_op *op) { (*opecode_F[op->opcode & 0x00FF])(m, op); }
+
+
+/* Every handler, in handler index order (index 0 is reserved for UNDECODED) */
+#define CHIP8_HANDLERS(X) \
+	X(NOOP) X(CLS) X(RET) X(JMP) X(CALL) X(SKIP_EQ) X(SKIP_N_EQ) X(SKIP_EQ_R) X(LD_BYTE) X(ADD) \
+	X(LD_R) X(BIT_OR) X(BIT_AND) X(BIT_XOR) X(BIT_ADD) X(BIT_SUB) X(BIT_SHR) X(BIT_SUBN) X(BIT_SHL) \
+	X(SKIP_N_EQ_R) X(SET_INDEX) X(JMP_OFFSET) X(RAND) X(DRAW) X(SKIP_KEY) X(SKIP_N_KEY) \
+	X(LD_DT) X(WAIT_KEY) X(SET_DT) X(SET_ST) X(I_ADD) X(LOAD_SPRITE) X(STORE_BCD) X(STORE_REGISTERS) X(LOAD_REGISTERS)
+
+#define HANDLER_POINTER(name) name,
+static void (*const handlers[])(struct Chip8Memory *, const struct chip8_op *) = { NULL, CHIP8_HANDLERS(HANDLER_POINTER) };
+#define HANDLER_COUNT (sizeof(handlers) / sizeof(handlers[0]))
+#define HANDLER_NAME(name) #name,
+static const char *const handler_names[] = { "UNDECODED", CHIP8_HANDLERS(HANDLER_NAME) };
+_Static_assert(HANDLER_COUNT <= PROFILE_HANDLER_SLOTS, "profile has fewer handler slots than handlers");
+
+#define IDLE_POINT(handler) ((handler) == JMP || (handler) == WAIT_KEY) // Handlers that can close an idle loop
+
+static uint8_t decode_table[0x10000]; // Opcode -> index into handlers[]
+static pthread_once_t decode_once = PTHREAD_ONCE_INIT;
+
+/* Handler the nested tables would pick for opcode */
+static void (*nested_handler(uint16_t opcode))(struct Chip8Memory *, const struct chip8_op *)
+{
+	switch (opcode >> 12)
+	{
+		case 0x0: return opcode_0[opcode & 0x000F];
+		case 0x8: return opcode_8[opcode & 0x000F];
+		case 0xE: return opcode_E[opcode & 0x000F];
+		case 0xF: return opecode_F[opcode & 0x00FF];
+		default:  return _exec[opcode >> 12];
+	}
+}
+
+/* Collapse the nested tables into decode_table (once per process) */
+static void build_decode_table()
+{
+	for (uint32_t opcode = 0; opcode <= 0xFFFF; opcode++)
+	{
+		void (*handler)(struct Chip8Memory *, const struct chip8_op *) = nested_handler((uint16_t)opcode);
+		for (uint8_t id = 1; id < HANDLER_COUNT; id++)
 		{
-			uint8_t spritePixel = spriteByte & (0x80u >> col);
-			uint32_t* screenPixel = &MEMORY->screen[(yPos + row) * SCREEN_WIDTH + (xPos + col)];
+			if (handlers[id] == handler) { decode_table[opcode] = id; break; }
+		}
+	}
+}
 
-			// Sprite pixel is on
-			if (spritePixel)
-			{
-				// Screen pixel also on - collision
-				if (*screenPixel == 0xFFFFFFFF)
-				{
-					MEMORY->registers[0xF] = 1;
-				}
-
-				// Effectively XOR with the sprite pixel
-				*screenPixel ^= 0xFFFFFFFF;
-			}
+
+/* Build decode tables used by the interpreter cores. Safe to call from any thread, any number of times */
+void initialize_decoder()
+{
+	pthread_once(&decode_once, build_decode_table);
+}
+
+
+/* Split opcode into handler index and operands */
+void decode_op(struct chip8_op *op, uint16_t opcode)
+{
+	op->handler = decode_table[opcode];
+	op->x = (opcode >> 8) & 0xF;
+	op->y = (opcode >> 4) & 0xF;
+	op->kk = opcode & 0xFF;
+	op->nnn = opcode & 0xFFF;
+	op->opcode = opcode;
+}
+
+
+/* Execute a decoded instruction (PC must already point past it) */
+void execute_op(struct Chip8Memory *machine, const struct chip8_op *op)
+{
+#ifdef CHIP8_CORE_NESTED
+	(*_exec[op->opcode >> 12])(machine, op);
+#else
+	(*handlers[op->handler])(machine, op);
+#endif
+}
+
+
+/* Decode and execute the instruction in machine->ir */
+void execute(struct Chip8Memory *machine)
+{
+	struct chip8_op op;
+	decode_op(&op, machine->ir);
+	execute_op(machine, &op);
+}
+
+
+/* Reset RAND's generator
+* - seed goes through a splitmix64 step, so any seed (including 0) gives a valid, well-mixed state
+*/
+void seed_rng(struct Chip8Memory *machine, uint64_t seed)
+{
+	uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	z ^= z >> 31;
+	machine->rng = z ? z : 0x9E3779B97F4A7C15ull;
+}
+
+
+/* Press (pressed != 0) or release keypad key (0x0 - 0xF)
+* - A press resumes a machine parked on WAIT_KEY, with the key in its Vx
+*/
+void set_key(struct Chip8Memory *machine, uint8_t key, int pressed)
+{
+	if (pressed) { machine->keypad |= (uint16_t)(1u << key); }
+	else { machine->keypad &= (uint16_t)~(1u << key); }
+
+	if (pressed && machine->key_wait)
+	{
+		machine->registers[machine->key_wait & 0xF] = key;
+		machine->key_wait = 0;
+	}
+}
+
+
+/* Tick timers (once per 60Hz frame, not per instruction) */
+void tick_timers(struct Chip8Memory *machine)
+{
+	if (machine->delay_timer > 0) { machine->delay_timer--; }
+	if (machine->sound_timer > 0) { machine->sound_timer--; }
+	if (machine->sound_timer) { /* Beep I didn't impliment */ }
+}
+
+
+/* Return predecoded instruction at PC and advance PC
+* - Even addresses come from machine->decoded, decoded on first execution
+* - Odd addresses (rare, but legal jump targets) are decoded into scratch every time
+* - PC wraps at TOTAL_RAM (Bnnn with a large V0, or running off 0xFFE)
+*/
+static inline const struct chip8_op *fetch(struct Chip8Memory *machine, struct chip8_op *scratch)
+{
+	uint16_t pc = machine->pc & (TOTAL_RAM - 1);
+	struct chip8_op *op = (pc & 1) ? scratch : &machine->decoded[pc >> 1];
+
+	if (op == scratch || op->handler == UNDECODED)
+	{
+		decode_op(op, (uint16_t)(machine->ram[pc] << 8u | machine->ram[(pc + 1) & (TOTAL_RAM - 1)]));
+	}
+	machine->ir = op->opcode;
+	machine->pc = pc + 0x0002;
+	return op;
+}
+
+
+/* Number of the next count instructions that provably leave the machine unchanged
+* - Only meaningful right after JMP or WAIT_KEY, with ir holding the instruction just executed
+*   (also at the start of an execute_cycles() call: ir still holds the last instruction the previous call ran)
+* - A machine parked on WAIT_KEY does nothing until set_key() (all count instructions)
+* - Input and timers only change between frames, so these loops can't exit mid-frame:
+*   - "JP" to itself re-executes itself (all count instructions)
+*   - "loop: LD Vx, DT; SE Vx, 0x00; JP loop" entered with Vx == DT != 0 repeats
+*     with no effect (whole 3-instruction iterations only, so state stays bit-identical)
+*/
+uint64_t idle_cycles(const struct Chip8Memory *machine, uint64_t count)
+{
+	if (machine->key_wait) { return count; }
+
+	uint16_t pc = machine->pc;
+	if (pc > TOTAL_RAM - 6) { return 0; }
+
+	const uint8_t *ram = machine->ram;
+	uint16_t opcode = (uint16_t)(ram[pc] << 8u | ram[pc + 1]);
+	uint8_t x = (opcode >> 8) & 0xF;
+
+	if (opcode == (0x1000 | pc) && opcode == machine->ir) { return count; }
+
+	if ((opcode & 0xF0FF) == 0xF007 && ram[pc + 2] == (0x30 | x) && ram[pc + 3] == 0x00 &&
+		machine->ir == (0x1000 | pc) && (uint16_t)(ram[pc + 4] << 8u | ram[pc + 5]) == machine->ir &&
+		machine->delay_timer != 0 && machine->registers[x] == machine->delay_timer)
+	{
+		return count - count % 3;
+	}
+	return 0;
+}
+
+
+/* Name of interpreter handler index (as in chip8_op.handler) */
+const char *handler_name(uint8_t handler)
+{
+	return (handler < HANDLER_COUNT) ? handler_names[handler] : "?";
+}
+
+
+static uint64_t nanoseconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+/* execute_cycles() of any core, counting every instruction into machine->profile
+* - Separate loop, so the uninstrumented cores pay one branch per call, not per instruction
+*/
+static uint64_t execute_cycles_profiled(struct Chip8Memory *machine, uint64_t count)
+{
+	struct chip8_profile *profile = machine->profile;
+	struct chip8_op scratch;
+	uint64_t start = nanoseconds();
+	uint64_t i = 0;
+	uint64_t executed = 0;
+
+	if (machine->key_wait) { profile->idle += count; machine->skipped += count; i = count; }
+	else // Still in the idle loop the last call ended in
+	{
+		i = idle_cycles(machine, count);
+		profile->idle += i;
+		machine->skipped += i;
+	}
+	while (i < count)
+	{
+		profile->pc_count[machine->pc & (TOTAL_RAM - 1)]++;
+		const struct chip8_op *op = fetch(machine, &scratch);
+		profile->handler_count[op->handler]++;
+
+		if (handlers[op->handler] == DRAW)
+		{
+			uint64_t draw_start = nanoseconds();
+			DRAW(machine, op);
+			profile->draw_ns += nanoseconds() - draw_start;
+		}
+		else { (*handlers[op->handler])(machine, op); }
+		i++;
+		executed++;
+
+		if (IDLE_POINT(handlers[op->handler]))
+		{
+			uint64_t idle = idle_cycles(machine, count - i);
+			profile->idle += idle;
+			machine->skipped += idle;
+			i += idle;
 		}
 	}
+
+	profile->instructions += executed;
+	profile->total_ns += nanoseconds() - start;
+	return count;
 }
 
-static void _0___();
-static void _8___();
-static void _E___();
-static void _F___();
 
-static void (*opcode_0[])() = { CLS, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, RET, NOOP };
+/* RAM range op is about to access, for the handlers that touch RAM (Fx55/Fx33 write, Fx65/DRAW read)
+* - Returns 0 for every other handler, so only these pay for watchpoints
+*/
+static int ram_access(const struct Chip8Memory *m, const struct chip8_op *op, uint32_t *length, int *write)
+{
+	void (*handler)(struct Chip8Memory *, const struct chip8_op *) = handlers[op->handler];
+	*write = (handler == STORE_REGISTERS || handler == STORE_BCD);
+	if (handler == STORE_REGISTERS || handler == LOAD_REGISTERS) { *length = op->x + 1; }
+	else if (handler == STORE_BCD) { *length = 3; }
+	else if (handler == DRAW) // Sprite rows actually read (clipped at the bottom edge)
+	{
+		uint32_t y = m->registers[op->y] % SCREEN_HEIGHT;
+		*length = ((op->kk & 0xF) < SCREEN_HEIGHT - y) ? (op->kk & 0xF) : SCREEN_HEIGHT - y;
+	}
+	else { return 0; }
+	return *length != 0;
+}
 
-static void (*opcode_8[])() = { LD_R, BIT_OR, BIT_AND, BIT_XOR, BIT_ADD, BIT_SUB, BIT_SHR, BIT_SUBN, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, BIT_SHL, NOOP };
+/* First byte of [address, address + length) set in watch bitmap, or -1 */
+static int32_t watched_byte(const uint64_t *watch, uint32_t address, uint32_t length)
+{
+	for (uint32_t i = 0; i < length; i++)
+	{
+		uint32_t byte = (address + i) & (TOTAL_RAM - 1);
+		if ((watch[byte >> 6] >> (byte & 63)) & 1) { return (int32_t)byte; }
+	}
+	return -1;
+}
 
-static void (*opcode_E[])() = {  NOOP, SKIP_N_KEY, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, SKIP_KEY, NOOP };
+/* execute_cycles() stopping before any instruction whose address is set in machine->debug->breakpoints
+* - One bitmap load per instruction; idle loops aren't fast-forwarded, so no address is skipped over
+* - A breakpoint with a condition is only a stop if the condition holds, evaluated right here at the bitmap hit
+* - While watches are set, the RAM-touching handlers stop before accessing a watched byte
+* - debug->resume lets the first instruction run even if it's on a breakpoint/watch (continuing from one)
+* - Returns instructions executed, debug->stop says why it returned early
+*/
+static uint64_t execute_cycles_debug(struct Chip8Memory *machine, uint64_t count)
+{
+	struct chip8_debug *debug = machine->debug;
+	struct chip8_op scratch;
 
-static void (*opecode_F[])() = { NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, LD_DT, NOOP, NOOP, WAIT_KEY, NOOP, NOOP, NOOP, NOOP, NOOP,
- 							     NOOP, NOOP, NOOP, NOOP, NOOP, SET_DT, NOOP, NOOP, SET_ST, NOOP, NOOP, NOOP, NOOP, NOOP, I_ADD, NOOP,
-							     NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, LOAD_SPRITE, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP,
-							     NOOP, NOOP, NOOP, STORE_BCD, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP,
- 							     NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP,
- 							     NOOP, NOOP, NOOP, NOOP, NOOP, STORE_REGISTERS, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP,
-							     NOOP, NOOP, NOOP, NOOP, NOOP, LOAD_REGISTERS, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP,
-							     NOOP, NOOP, NOOP, NOOP, NOOP, LOAD_REGISTERS, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP, NOOP };
+	debug->stop = DEBUG_STOP_NONE;
+	for (uint64_t i = 0; i < count; i++)
+	{
+		if (machine->key_wait) { machine->skipped += count - i; return count; }
+		uint16_t pc = machine->pc & (TOTAL_RAM - 1);
+		if (((debug->breakpoints[pc >> 6] >> (pc & 63)) & 1) && !debug->resume &&
+			(debug->conditions[pc] == NULL || debug_condition_holds(debug->conditions[pc], machine)))
+		{
+			debug->stop = DEBUG_STOP_BREAKPOINT;
+			return i;
+		}
 
+		const struct chip8_op *op = fetch(machine, &scratch);
+		uint32_t length;
+		int write;
+		if (debug->watching && !debug->resume && ram_access(machine, op, &length, &write))
+		{
+			int32_t byte = watched_byte(write ? debug->write_watch : debug->read_watch, machine->index, length);
+			if (byte >= 0)
+			{
+				machine->pc -= 2; // Undo the fetch: stop before the access, like a breakpoint
+				debug->stop = DEBUG_STOP_WATCH;
+				debug->watch_address = (uint16_t)byte;
+				debug->watch_write = (uint8_t)write;
+				return i;
+			}
+		}
+		debug->resume = 0;
+		if (debug->history) { history_record(debug->history, machine, op); }
+		(*handlers[op->handler])(machine, op);
+		if (handlers[op->handler] == RET && machine->sp > debug->finish_sp) // Stack grows towards 0
+		{
+			debug->stop = DEBUG_STOP_FINISH;
+			return i + 1;
+		}
+	}
+	return count;
+}
 
-static void (*_exec[])() = {_0___, JMP, CALL, SKIP_EQ, SKIP_N_EQ, SKIP_EQ_R, LD_BYTE, ADD, _8___, SKIP_N_EQ_R, SET_INDEX, JMP_OFFSET, RAND, DRAW, _E___, _F___};
-static void _0___() { (*opcode_0[MEMORY->ir & 0x000F])(); }
-static void _8___() { (*opcode_8[MEMORY->ir & 0x000F])(); }
-static void _E___() { (*opcode_E[MEMORY->ir & 0x000F])(); }
-static void _F___() { (*opecode_F[MEMORY->ir & 0x00FF])(); }
 
-void execute()
+/* execute_cycles() of the built-in interpreter core, appending every instruction to machine->trace
+* - Dispatches the way that core does (threaded labels, _exec[], or handlers[]), so the trace covers its decode paths
+* - No idle fast-forward, so every instruction executed is in the trace
+* - The JIT is not traced, jit_execute() runs blocks without per-instruction exits (check it with --lockstep)
+*/
+static uint64_t execute_cycles_traced(struct Chip8Memory *machine, uint64_t count)
 {
-	(*_exec[MEMORY->ir >> 12])();
+	struct chip8_op scratch;
+	const struct chip8_op *op;
+	uint8_t registers[16];
+	uint16_t pc;
+	uint64_t i = 0;
+
+#ifdef CHIP8_CORE_THREADED
+	#define TRACED_LABEL(name) &&traced_##name,
+	static void *const labels[] = { NULL, CHIP8_HANDLERS(TRACED_LABEL) };
+
+	#define DISPATCH() do { if (i == count) { return count; } \
+		if (machine->key_wait) { machine->skipped += count - i; return count; } \
+		pc = machine->pc; memcpy(registers, machine->registers, sizeof(registers)); \
+		op = fetch(machine, &scratch); goto *labels[op->handler]; } while (0)
+	#define TRACED_BODY(name) traced_##name: name(machine, op); \
+		trace_record(machine->trace, machine, pc, op->opcode, registers); i++; DISPATCH();
+
+	DISPATCH();
+	CHIP8_HANDLERS(TRACED_BODY)
+
+	#undef DISPATCH
+	#undef TRACED_BODY
+	#undef TRACED_LABEL
+#else
+	for (; i < count; i++)
+	{
+		if (machine->key_wait) { machine->skipped += count - i; return count; }
+		pc = machine->pc;
+		memcpy(registers, machine->registers, sizeof(registers));
+		op = fetch(machine, &scratch);
+	#ifdef CHIP8_CORE_NESTED
+		(*_exec[op->opcode >> 12])(machine, op);
+	#else
+		(*handlers[op->handler])(machine, op);
+	#endif
+		trace_record(machine->trace, machine, pc, op->opcode, registers);
+	}
+	return count;
+#endif
 }
 
+
+/* Fetch, decode, and execute count instructions, returns number executed
+* - After JMP/WAIT_KEY, and on entry (like jit_execute() before every block), idle loops are fast-forwarded (see idle_cycles())
+* - A machine parked on WAIT_KEY counts count instructions as executed without running any
+* - Fast-forwarded instructions are also added to machine->skipped
+* - With a profile attached, runs the instrumented loop instead
+* - With a debugger attached, runs the breakpoint-checking loop instead (and may return early)
+* - With a trace attached, runs the recording loop instead
+*/
+uint64_t execute_cycles(struct Chip8Memory *machine, uint64_t count)
+{
+	struct chip8_op scratch;
+	const struct chip8_op *op;
+
+	if (machine->debug) { return execute_cycles_debug(machine, count); }
+	if (machine->trace) { return execute_cycles_traced(machine, count); }
+	if (machine->profile) { return execute_cycles_profiled(machine, count); }
+	if (machine->key_wait) { machine->skipped += count; return count; }
+
+	uint64_t idle = idle_cycles(machine, count); // Still in the idle loop the last call ended in
+	machine->skipped += idle;
+	if (idle == count) { return count; }
+
+#ifdef CHIP8_CORE_THREADED
+	#define HANDLER_LABEL(name) &&op_##name,
+	static void *const labels[] = { NULL, CHIP8_HANDLERS(HANDLER_LABEL) };
+	uint64_t remaining = count - idle;
+
+	#define DISPATCH() do { op = fetch(machine, &scratch); goto *labels[op->handler]; } while (0)
+	#define HANDLER_BODY(name) op_##name: name(machine, op); if (--remaining == 0) { return count; } \
+		if (IDLE_POINT(name)) { idle = idle_cycles(machine, remaining); machine->skipped += idle; remaining -= idle; if (remaining == 0) { return count; } } \
+		DISPATCH();
+
+	DISPATCH();
+	CHIP8_HANDLERS(HANDLER_BODY)
+
+	#undef DISPATCH
+	#undef HANDLER_BODY
+	#undef HANDLER_LABEL
+#else
+	for (uint64_t i = idle; i < count; i++)
+	{
+		op = fetch(machine, &scratch);
+	#ifdef CHIP8_CORE_NESTED
+		(*_exec[op->opcode >> 12])(machine, op);
+	#else
+		(*handlers[op->handler])(machine, op);
+	#endif
+		if (IDLE_POINT(handlers[op->handler]))
+		{
+			idle = idle_cycles(machine, count - i - 1);
+			machine->skipped += idle;
+			i += idle;
+		}
+	}
+	return count;
+#endif
+}
@@ -6,30 +6,62 @@
 
 /* PUBLIC FUNCTIONS
    - initialize_memory()
-   - release_memory()
+   - initialize_decoder()
+   - execute()
+   - decode_op()
+   - execute_op()
+   - execute_cycles()
+   - idle_cycles()
+   - handler_name()
+   - tick_timers()
+   - set_key()
+   - seed_rng()
+   - invalidate_decoded()
 
    PUBLIC STRUCTS
    - Chip8Memory
-
-   PUBLIC VARIABLES
-   - Chip8Memory *MEMORY
+   - chip8_op
 */
 
 #ifndef POTATOCHIP_CHIP8
 #define POTATOCHIP_CHIP8
 
 #include <stdint.h>
+#include <stddef.h>
 
 #define TOTAL_RAM 4096
 #define STACK_SIZE 16
 #define RAM_RESERVED_SIZE 512 // Memory reserved for CHIP-8 interpreter
 #define SCREEN_HEIGHT 32u
 #define SCREEN_WIDTH 64u
+#define FRAME_RATE 60 // Timer rate (Hz), one frame per timer tick
+#define CYCLES_PER_FRAME 9 // Default instructions executed per frame (540 IPS)
+
+#define UNDECODED 0 // chip8_op.handler of a cache entry not yet decoded
+
+struct chip8_jit; // jit.h
+struct chip8_profile; // profile.h
+struct chip8_debug; // debugger.h
+struct chip8_trace; // trace.h
+
+/* Predecoded instruction: handler index plus operands extracted once */
+struct chip8_op{
+	uint8_t handler;  // Index into interpreter handler table, UNDECODED if not decoded yet
+	uint8_t x;        // 0x_x__
+	uint8_t y;        // 0x__y_
+	uint8_t kk;       // 0x__kk (n is kk & 0xF)
+	uint16_t nnn;     // 0x_nnn
+	uint16_t opcode;  // Raw instruction
+};
 
 /*
-* MEMORY ptr is declared so it can be used by any file that
-* includes chip8.h. MEMORY is allocated by initialize_memory(),
-* and freed by release_memory()
+* Complete state of one CHIP-8 machine. There is no global
+* instance; callers allocate as many as they need (stack, heap,
+* or pool) and pass them to initialize_memory(), execute(), etc.
+*
+* Everything before dirty_rows is emulated state (MACHINE_STATE_SIZE
+* bytes, saved/restored as one block by savestate.c); the rest is
+* host-side bookkeeping rebuilt after a restore.
 */
 struct Chip8Memory{ 
 	uint8_t delay_timer;
@@ -41,17 +73,56 @@ struct Chip8Memory{
 	uint8_t sp;          // Stack pointer
 	uint16_t stack[STACK_SIZE]; // Stack, used for storing return addresses (LIFO, high to low)
 	uint8_t ram[TOTAL_RAM];
-	uint32_t screen[SCREEN_WIDTH * SCREEN_HEIGHT];
-	uint8_t keypad[16];
-} *MEMORY; 
+	uint64_t screen[SCREEN_HEIGHT]; // One bit per pixel, bit 63 of each row is x 0
+	uint16_t keypad; // Bit k set while key k is held
+	uint8_t key_wait; // Non-zero while parked on WAIT_KEY: 0x10 | x (Vx receives the key)
+	uint64_t rng; // xorshift64* state for RAND (never 0), see seed_rng()
+	uint32_t dirty_rows; // Bit n set = screen row n changed since last present (cleared by the frontend)
+	uint64_t skipped; // Instructions counted as executed but fast-forwarded (idle loops, WAIT_KEY), see idle_cycles()
+	struct chip8_op decoded[TOTAL_RAM / 2]; // Predecode cache, one entry per even RAM address
+	struct chip8_jit *jit; // Attached JIT (NULL = interpreter only)
+	struct chip8_profile *profile; // Attached profiler (NULL = off), see execute_cycles()
+	struct chip8_debug *debug; // Attached debugger breakpoints (NULL = off), see execute_cycles()
+	struct chip8_trace *trace; // Attached execution trace (NULL = off), see execute_cycles()
+};
+
+#define MACHINE_STATE_SIZE offsetof(struct Chip8Memory, dirty_rows) // Bytes of emulated state at the start of struct Chip8Memory
+
+
+/* Initialize RAM and registers of caller-allocated machine */
+int initialize_memory(struct Chip8Memory *machine);
+
+/* Build decode tables for the selected interpreter core (done by initialize_memory()) */
+void initialize_decoder();
+
+/* Decode and execute the instruction in machine->ir */
+void execute(struct Chip8Memory *machine);
+
+/* Split opcode into handler index and operands */
+void decode_op(struct chip8_op *op, uint16_t opcode);
+
+/* Execute a decoded instruction (PC must already point past it) */
+void execute_op(struct Chip8Memory *machine, const struct chip8_op *op);
+
+/* Fetch, decode, and execute count instructions, returns number executed */
+uint64_t execute_cycles(struct Chip8Memory *machine, uint64_t count);
+
+/* Name of interpreter handler index (as in chip8_op.handler) */
+const char *handler_name(uint8_t handler);
+
+/* Number of the next count instructions that provably leave the machine unchanged (idle loops) */
+uint64_t idle_cycles(const struct Chip8Memory *machine, uint64_t count);
 
+/* Decrement delay/sound timers, called once per 60Hz frame */
+void tick_timers(struct Chip8Memory *machine);
 
-/* Initialize RAM and registers, allocate MEMORY ptr */
-int initialize_memory();
+/* Reset RAND's generator, same seed = same sequence of random bytes */
+void seed_rng(struct Chip8Memory *machine, uint64_t seed);
 
-/* Free global MEMORY struct, registers, and RAM  */
-void release_memory();
+/* Press (pressed != 0) or release keypad key (0x0 - 0xF), resuming a machine parked on WAIT_KEY */
+void set_key(struct Chip8Memory *machine, uint8_t key, int pressed);
 
-void execute();
+/* Drop predecoded instructions overlapping RAM that was written outside of the CPU */
+void invalidate_decoded(struct Chip8Memory *machine, uint32_t address, uint32_t length);
 
 #endif // POTATOCHIP_CHIP8
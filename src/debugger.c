@@ -3,15 +3,13 @@
 *
 * Functions for Testing/Debugging
 *
-* Dumping functions pull the global MEMORY 
-* struct directly, so there's no need to pass
-* it as an argument.
+* Dumping functions and the ncurses debugger
+* operate on the machine passed in by the caller.
 */
 
 /* TODO:
 
 - GUI
-- Disassembler function
 
 */
 
@@ -20,18 +18,28 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <strings.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <ncurses.h>
 #include "debugger.h"
-#include "chip8.h" // Chip8Memory *MEMORY, RAM_DATA_SIZE, TOTAL_RAM, STACK_SIZE
+#include "chip8.h" // struct Chip8Memory, TOTAL_RAM, STACK_SIZE
 #include "emulator.h"
+#include "history.h"
 
 
-#define MAX_CMD_SIZE 50
+#define MAX_CMD_SIZE 80
 
 #define ROWLENGTH 16
 
 /* Dump RAM offset: values (upper limit exclusionary) */
-void dump_memory(uint16_t start_offset, uint16_t stop_offset)
+void dump_memory(struct Chip8Memory *machine, uint16_t start_offset, uint16_t stop_offset)
 {
 	if ((start_offset >= TOTAL_RAM) || (stop_offset > TOTAL_RAM))
 	{
@@ -39,7 +47,7 @@ void dump_memory(uint16_t start_offset, uint16_t stop_offset)
 		return;
 	}
 
-	uint8_t *offset_memory = MEMORY->ram + start_offset;
+	uint8_t *offset_memory = machine->ram + start_offset;
 
 	for (uint16_t i = 0; i < stop_offset-start_offset; i++)
 	{		
@@ -52,170 +60,166 @@ void dump_memory(uint16_t start_offset, uint16_t stop_offset)
 	puts("");
 }
 
-/* Disassemble single instruction and return result string in given buffer */
-void disassemble_instruction(char results_buffer[], size_t buffer_size, uint16_t instruction)
+/* Mnemonic templates, lowercase letters are operands:
+* x/y = register nibble, n = 0xN, b = 0xKK, a = 0xNNN (no mnemonic has lowercase letters)
+* Indexed by the opcode's top nibble, then by (opcode & mask); NULL = unknown instruction
+*/
+struct template_group{
+	const char *const *templates;
+	uint8_t mask;
+};
+
+static const char *const templates_0[256] = { [0x00] = "NOP", [0xE0] = "CLS", [0xEE] = "RET" };
+static const char *const templates_8[16] = {
+	"LD Vx, Vy", "OR Vx, Vy", "AND Vx, Vy", "XOR Vx, Vy", "ADD Vx, Vy", "SUB Vx, Vy", "SHR Vx {, Vy}", "SUBN Vx, Vy",
+	[0xE] = "SHL Vx {, Vy}"
+};
+static const char *const templates_E[256] = { [0x9E] = "SKP Vx", [0xA1] = "SKNP Vx" };
+static const char *const templates_F[256] = {
+	[0x07] = "LD Vx, DT", [0x0A] = "LD Vx, K", [0x15] = "LD DT, Vx", [0x18] = "LD ST, Vx", [0x1E] = "ADD I, Vx",
+	[0x29] = "LD F, Vx", [0x33] = "LD B, Vx", [0x55] = "LD [I], Vx", [0x65] = "LD Vx, [I]"
+};
+
+static const struct template_group template_groups[16] = {
+	{ templates_0, 0xFF },
+	{ (const char *const[]){ "JP a" }, 0 },
+	{ (const char *const[]){ "CALL a" }, 0 },
+	{ (const char *const[]){ "SE Vx, b" }, 0 },
+	{ (const char *const[]){ "SNE Vx, b" }, 0 },
+	{ (const char *const[]){ "SE Vx, Vy" }, 0 },
+	{ (const char *const[]){ "LD Vx, b" }, 0 },
+	{ (const char *const[]){ "ADD Vx, b" }, 0 },
+	{ templates_8, 0xF },
+	{ (const char *const[]){ "SNE Vx, Vy" }, 0 },
+	{ (const char *const[]){ "LD I, a" }, 0 },
+	{ (const char *const[]){ "JP a + V0" }, 0 },
+	{ (const char *const[]){ "RND Vx, b" }, 0 },
+	{ (const char *const[]){ "DRW Vx, Vy, n" }, 0 },
+	{ templates_E, 0xFF },
+	{ templates_F, 0xFF },
+};
+
+static const char hex_digits[16] = "0123456789ABCDEF";
+
+/* Write "0x" and the low digits hex digits of value */
+static char *put_hex(char *out, uint32_t value, int digits)
 {
-	memset(results_buffer, 0, buffer_size);
-	char operands[7] = {0};
-	snprintf(results_buffer, buffer_size, "Unknown instruction: 0x%04X", instruction);	
-	switch(instruction >> 12) {
-
-		case 0:
-			switch(instruction & 0xFF){
-				case 0xE0:
-					snprintf(results_buffer, buffer_size, "CLS");
-					break;
-				case 0xEE:
-					snprintf(results_buffer, buffer_size, "RET");
-					break;
-				case 0x00:
-					snprintf(results_buffer, buffer_size, "NOP");
-					break;
-			}
-			break;
-		case 1:
-			snprintf(results_buffer, buffer_size, "JP 0x%03X", (instruction & 0xFFF));
-			break;
-		case 2:
-			snprintf(results_buffer, buffer_size, "CALL 0x%03X", (instruction & 0xFFF));
-			break;
-		case 3:
-			snprintf(results_buffer, buffer_size, "SE V%X, 0x%02X", ((instruction >> 8) & 0xF), (instruction & 0xFF));
-			break;
-		case 4:
-			snprintf(results_buffer, buffer_size, "SNE V%X, 0x%02X", ((instruction >> 8) & 0xF), (instruction & 0xFF));
-			break;
-		case 5:
-			snprintf(results_buffer, buffer_size, "SE V%X, V%X", ((instruction >> 8) & 0xF), ((instruction >> 4) & 0xF));
-			break;
-		case 6:
-			snprintf(results_buffer, buffer_size, "LD V%X, 0x%02X", ((instruction >> 8) & 0xF), (instruction & 0xFF));
-			break;
-		case 7:
-			snprintf(results_buffer, buffer_size, "ADD V%X, 0x%02X", ((instruction >> 8) & 0xF), (instruction & 0xFF));
-			break;
-		case 8:
-			snprintf(operands, 7, "V%X, V%X", ((instruction >> 8) & 0xF), ((instruction >> 4) & 0xF));
-			switch(instruction & 0xF){
-				case 0:
-					snprintf(results_buffer, buffer_size, "LD %s", operands);
-					break;
-				case 1:
-					snprintf(results_buffer, buffer_size, "OR %s", operands);
-					break;
-				case 2:
-					snprintf(results_buffer, buffer_size, "AND %s", operands);
-					break;
-				case 3:
-					snprintf(results_buffer, buffer_size, "XOR %s", operands);
-					break;
-				case 4:
-					snprintf(results_buffer, buffer_size, "ADD %s", operands);
-					break;
-				case 5:
-					snprintf(results_buffer, buffer_size, "SUB %s", operands);
-					break;
-				case 6:
-					snprintf(results_buffer, buffer_size, "SHR V%X {, V%X}", ((instruction >> 8) & 0xF), ((instruction >> 4) & 0xF));
-					break;
-				case 7:
-					snprintf(results_buffer, buffer_size, "SUBN %s", operands);
-					break;
-				case 0xE:
-					snprintf(results_buffer, buffer_size, "SHL V%X {, V%X}", ((instruction >> 8) & 0xF), ((instruction >> 4) & 0xF));
-					break;
-			}
-			break;
-		case 9:
-			snprintf(results_buffer, buffer_size, "SNE V%X, V%X", ((instruction >> 8) & 0xF), ((instruction >> 4) & 0xF));
-			break;
-		case 0xA:
-			snprintf(results_buffer, buffer_size, "LD I, 0x%03X", (instruction & 0xFFF));
-			break;
-		case 0xB:
-			snprintf(results_buffer, buffer_size, "JP 0x%03X + V0", (instruction & 0xFFF));
-			break;
-		case 0xC:
-			snprintf(results_buffer, buffer_size, "RND V%X, 0x%02X", ((instruction >> 8) & 0xF), (instruction & 0xFF));
-			break;
-		case 0xD:
-			snprintf(results_buffer, buffer_size, "DRW V%X, V%X, 0x%X", ((instruction >> 8) & 0xF), ((instruction >> 4) & 0xF), (instruction & 0xF));
-			break;
-		case 0xE:
-			switch(instruction & 0xFF){
-				case 0x9E:
-					snprintf(results_buffer, buffer_size, "SKP V%X", ((instruction >> 8) & 0xF));
-					break;
-				case 0xA1:
-					snprintf(results_buffer, buffer_size, "SKNP V%X", ((instruction >> 8) & 0xF));
-					break;
-			}
-			break;
-		case 0xF:
-			snprintf(operands, 3, "V%X", ((instruction >> 8) & 0xF));
-			switch(instruction & 0xFF){
-				case 0x07:
-					snprintf(results_buffer, buffer_size, "LD %s, DT", operands);
-					break;
-				case 0x0A:
-					snprintf(results_buffer, buffer_size, "LD %s, K", operands);
-					break;
-				case 0x15:
-					snprintf(results_buffer, buffer_size, "LD DT, %s", operands);
-					break;
-				case 0x18:
-					snprintf(results_buffer, buffer_size, "LD ST, %s", operands);
-					break;
-				case 0x1E:
-					snprintf(results_buffer, buffer_size, "ADD I, %s", operands);
-					break;
-				case 0x29:
-					snprintf(results_buffer, buffer_size, "LD F, %s", operands);
-					break;
-				case 0x33:
-					snprintf(results_buffer, buffer_size, "LD B, %s", operands);
-					break;
-				case 0x55:
-					snprintf(results_buffer, buffer_size, "LD [I], %s", operands);
-					break;
-				case 0x65:
-					snprintf(results_buffer, buffer_size, "LD %s, [I]", operands);
-					break;
-			}
-			break;
+	*out++ = '0';
+	*out++ = 'x';
+	while (digits--) { *out++ = hex_digits[(value >> (digits * 4)) & 0xF]; }
+	return out;
+}
+
+/* 1 if instruction has a mnemonic (the disassembler doesn't print it as unknown) */
+int known_instruction(uint16_t instruction)
+{
+	const struct template_group *group = &template_groups[instruction >> 12];
+	return group->templates[instruction & group->mask] != NULL;
+}
+
+/* Write mnemonic of instruction to out (at most MNEMONIC_MAX bytes, not null-terminated), returns length */
+size_t format_instruction(char out[], uint16_t instruction)
+{
+	const struct template_group *group = &template_groups[instruction >> 12];
+	const char *template = group->templates[instruction & group->mask];
+	char *end = out;
+
+	if (template == NULL)
+	{
+		memcpy(end, "Unknown instruction: ", 21);
+		return put_hex(end + 21, instruction, 4) - out;
 	}
+	for (; *template; template++)
+	{
+		switch (*template) {
+			case 'x': *end++ = hex_digits[(instruction >> 8) & 0xF]; break;
+			case 'y': *end++ = hex_digits[(instruction >> 4) & 0xF]; break;
+			case 'n': end = put_hex(end, instruction, 1); break;
+			case 'b': end = put_hex(end, instruction, 2); break;
+			case 'a': end = put_hex(end, instruction, 3); break;
+			default: *end++ = *template;
+		}
+	}
+	return end - out;
+}
 
-	results_buffer[buffer_size] = '\0'; // Manually adding null-terminator just in case
+/* Disassemble single instruction and return result string in given buffer (truncated to fit) */
+void disassemble_instruction(char results_buffer[], size_t buffer_size, uint16_t instruction)
+{
+	if (buffer_size == 0) { return; }
+	char mnemonic[MNEMONIC_MAX];
+	size_t length = format_instruction(mnemonic, instruction);
+	if (length > buffer_size - 1) { length = buffer_size - 1; }
+	memcpy(results_buffer, mnemonic, length);
+	results_buffer[length] = '\0';
 }
 
-/* Print disassembly of ROM at given path*/
-void disassemble_file(const char *path)
+
+#define DISAS_CHUNK 65536
+#define DISAS_LINE_MAX (8 + MNEMONIC_MAX + 1) // "0xAAAA: " + mnemonic + '\n'
+
+/* write() all of buffer to stdout */
+static int write_all(const char *buffer, size_t size)
 {
-	uint8_t read_buffer[4096];
-	memset(read_buffer, 0, 4096);
+	while (size > 0)
+	{
+		ssize_t written = write(STDOUT_FILENO, buffer, size);
+		if (written < 0 && errno == EINTR) { continue; }
+		if (written <= 0) { return -1; }
+		buffer += written;
+		size -= written;
+	}
+	return 0;
+}
 
-	FILE *ROMfp = fopen(path, "r");
-	if (ROMfp == NULL)
+/* Print disassembly of ROM at given path
+* - ROM is mmap'd, lines are formatted into a chunk buffer written with one write() per chunk
+* - Addresses start at 0x200; an odd trailing byte is disassembled with a 0x00 low byte
+*/
+void disassemble_file(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
 	{
 		printf("Error opening file '%s'\n", path);
 		return;
 	}
-	size_t bytes_read = fread(read_buffer, 1, 4096, ROMfp); // MEMORY must be initialized first
-	fclose(ROMfp);
-
-	if (bytes_read < 2)
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < 2)
+	{
+		printf("Error reading bytes from '%s'\n", path);
+		close(fd);
+		return;
+	}
+	size_t size = st.st_size;
+	const uint8_t *rom = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (rom == MAP_FAILED)
 	{
 		printf("Error reading bytes from '%s'\n", path);
 		return;
 	}
+	madvise((void *)rom, size, MADV_SEQUENTIAL);
+	fflush(stdout);
 
-	char mnemonic_buffer[30];
-	size_t buffer_size = sizeof(mnemonic_buffer);
-	for (int i = 0; i < (int)bytes_read; i+=2)
+	static char chunk[DISAS_CHUNK];
+	char *out = chunk;
+	for (size_t i = 0; i < size; i += 2)
 	{
-		disassemble_instruction(mnemonic_buffer, buffer_size, (uint16_t)(read_buffer[i] << 8u | read_buffer[i + 1]));
-		printf("0x%03X: %s\n", 0x200+i, mnemonic_buffer);
+		if (out + DISAS_LINE_MAX > chunk + DISAS_CHUNK)
+		{
+			if (write_all(chunk, out - chunk) != 0) { break; }
+			out = chunk;
+		}
+		uint32_t address = 0x200 + i;
+		out = put_hex(out, address, (address > 0xFFFFF) ? 8 : (address > 0xFFFF) ? 5 : (address > 0xFFF) ? 4 : 3);
+		*out++ = ':';
+		*out++ = ' ';
+		out += format_instruction(out, (uint16_t)(rom[i] << 8u | ((i + 1 < size) ? rom[i + 1] : 0)));
+		*out++ = '\n';
 	}
+	write_all(chunk, out - chunk);
+	munmap((void *)rom, size);
 }
 
 
@@ -236,73 +240,431 @@ static void destroy_window(WINDOW *local_win)
 }
 
 
-static void update_registers(WINDOW *rwin)
+#define DISAS_ROWS 25      // Instructions shown in the disassembly window
+#define DEBUG_LIVE_HZ 20   // Window redraws per second while running
+
+/* Ncurses windows and the machine state they currently show
+* - Redraws compare against this and only repaint lines that changed, then flush everything with one doupdate()
+*/
+struct debug_view{
+	WINDOW *disas;
+	WINDOW *registers;
+	WINDOW *stack;
+	int valid;                      // 0 = repaint every line on the next redraw
+	int live;                       // Redraw at DEBUG_LIVE_HZ while running
+	uint16_t pc;
+	uint16_t index;
+	uint8_t sp;
+	uint8_t v[16];
+	uint16_t stack_values[STACK_SIZE];
+	uint16_t disas_start;           // First address shown, kept while PC stays on screen
+	uint32_t disas_rows[DISAS_ROWS]; // Shown instruction | address << 16 | breakpoint << 28 | PC << 29
+};
+
+static void update_registers(struct debug_view *view, struct Chip8Memory *machine)
 {
+	WINDOW *rwin = view->registers;
 	int row = 1;
 	int column = 1;
 
-	wmove(rwin, row, column);
-	wclrtoeol(rwin);
-	wprintw(rwin, "PC: 0x%04X", MEMORY->pc);
-
-	wmove(rwin, row+1, column);
-	wclrtoeol(rwin);
-	wprintw(rwin, "I : 0x%04X", MEMORY->index);
-
-	wmove(rwin, row+2, column);
-	wclrtoeol(rwin);
-	wprintw(rwin, "SP: 0x%X", MEMORY->sp);
+	if (!view->valid || view->pc != machine->pc) { mvwprintw(rwin, row, column, "PC: 0x%04X", machine->pc); }
+	if (!view->valid || view->index != machine->index) { mvwprintw(rwin, row+1, column, "I : 0x%04X", machine->index); }
+	if (!view->valid || view->sp != machine->sp) { mvwprintw(rwin, row+2, column, "SP: 0x%X", machine->sp); }
 
 	for (int i = 0; i < 16; i++)
 	{
-		wmove(rwin, row+i+3, column);
-		wclrtoeol(rwin);
-		wprintw(rwin, "V%X: 0x%02X", i, MEMORY->registers[i]);
+		if (view->valid && view->v[i] == machine->registers[i]) { continue; }
+		mvwprintw(rwin, row+i+3, column, "V%X: 0x%02X", i, machine->registers[i]);
+		view->v[i] = machine->registers[i];
 	}
-	box(rwin, 0 , 0);
-	wrefresh(rwin);
+	view->pc = machine->pc;
+	view->index = machine->index;
+	wnoutrefresh(rwin);
 }
 
-static void update_stack(WINDOW *swin)
+static void update_stack(struct debug_view *view, struct Chip8Memory *machine)
 {
+	WINDOW *swin = view->stack;
 	int row = 1;
 	int column = 1;
 
 	for (int i = 0; i < STACK_SIZE; i++)
 	{
-		wmove(swin, row+i, column);
-		wclrtoeol(swin);
-		if (i == MEMORY->sp)
+		int marked = (i == machine->sp) || (i == view->sp); // SP arrow moved onto or off this line
+		if (view->valid && !marked && view->stack_values[i] == machine->stack[i]) { continue; }
+		mvwprintw(swin, row+i, column, "0x%X: 0x%04X%s", i, machine->stack[i], (i == machine->sp) ? "<-SP" : "    ");
+		view->stack_values[i] = machine->stack[i];
+	}
+	view->sp = machine->sp;
+	wnoutrefresh(swin);
+}
+
+static int is_breakpoint(const struct chip8_debug *debug, uint16_t address)
+{
+	return debug && ((debug->breakpoints[address >> 6] >> (address & 63)) & 1);
+}
+
+static void set_breakpoint(struct chip8_debug *debug, uint16_t address, int enabled)
+{
+	if (enabled) { debug->breakpoints[address >> 6] |= 1ull << (address & 63); }
+	else { debug->breakpoints[address >> 6] &= ~(1ull << (address & 63)); }
+}
+
+/* Breakpoint conditions ("break ADDR if ..."), compiled once into stack bytecode
+* - Operands: V0-VF, I, PC, SP, DT, ST, numbers (0x hex or decimal)
+* - Operators: == != < <= > >= && || and parentheses
+*/
+#define CONDITION_SIZE 64
+#define CONDITION_STACK 16
+
+enum condition_op{
+	COND_END = 0,
+	COND_CONST,  // Followed by 2-byte little-endian value
+	COND_V,      // Followed by register number
+	COND_I, COND_PC, COND_SP, COND_DT, COND_ST,
+	COND_EQ, COND_NE, COND_LT, COND_LE, COND_GT, COND_GE, COND_AND, COND_OR,
+};
+
+struct debug_condition{
+	uint8_t code[CONDITION_SIZE];
+	char text[MAX_CMD_SIZE];
+};
+
+struct condition_parser{
+	const char *p;
+	struct debug_condition *condition;
+	size_t length;
+	int depth;     // Values on the evaluation stack after the code so far
+	int max_depth;
+	int error;
+};
+
+static void emit(struct condition_parser *parser, uint8_t byte, int stack_change)
+{
+	if (parser->length >= CONDITION_SIZE - 1) { parser->error = 1; return; } // Keep room for COND_END
+	parser->condition->code[parser->length++] = byte;
+	parser->depth += stack_change;
+	if (parser->depth > parser->max_depth) { parser->max_depth = parser->depth; }
+}
+
+static int accept(struct condition_parser *parser, const char *token)
+{
+	while (*parser->p == ' ') { parser->p++; }
+	size_t length = strlen(token);
+	if (strncmp(parser->p, token, length) != 0) { return 0; }
+	parser->p += length;
+	return 1;
+}
+
+/* Name of exactly these letters (case-insensitive), not followed by more of a word */
+static int accept_name(struct condition_parser *parser, const char *name)
+{
+	while (*parser->p == ' ') { parser->p++; }
+	size_t length = strlen(name);
+	if (strncasecmp(parser->p, name, length) != 0 || isalnum((unsigned char)parser->p[length])) { return 0; }
+	parser->p += length;
+	return 1;
+}
+
+static void parse_or(struct condition_parser *parser);
+
+static void parse_operand(struct condition_parser *parser)
+{
+	static const struct { const char *name; uint8_t op; } names[] = {
+		{ "PC", COND_PC }, { "SP", COND_SP }, { "DT", COND_DT }, { "ST", COND_ST }, { "I", COND_I },
+	};
+
+	if (accept(parser, "("))
+	{
+		parse_or(parser);
+		if (!accept(parser, ")")) { parser->error = 1; }
+		return;
+	}
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+	{
+		if (accept_name(parser, names[i].name)) { emit(parser, names[i].op, 1); return; }
+	}
+	if ((parser->p[0] == 'V' || parser->p[0] == 'v') && isxdigit((unsigned char)parser->p[1]) && !isalnum((unsigned char)parser->p[2]))
+	{
+		emit(parser, COND_V, 1);
+		emit(parser, (uint8_t)strtoul((char[]){ parser->p[1], '\0' }, NULL, 16), 0);
+		parser->p += 2;
+		return;
+	}
+	if (isdigit((unsigned char)parser->p[0]))
+	{
+		char *end;
+		unsigned long value = strtoul(parser->p, &end, 0);
+		if (value > 0xFFFF) { parser->error = 1; return; }
+		parser->p = end;
+		emit(parser, COND_CONST, 1);
+		emit(parser, value & 0xFF, 0);
+		emit(parser, value >> 8, 0);
+		return;
+	}
+	parser->error = 1;
+}
+
+static void parse_comparison(struct condition_parser *parser)
+{
+	static const struct { const char *token; uint8_t op; } comparisons[] = { // Two-character tokens first
+		{ "==", COND_EQ }, { "!=", COND_NE }, { "<=", COND_LE }, { ">=", COND_GE }, { "<", COND_LT }, { ">", COND_GT },
+	};
+
+	parse_operand(parser);
+	for (size_t i = 0; i < sizeof(comparisons) / sizeof(comparisons[0]); i++)
+	{
+		if (accept(parser, comparisons[i].token))
 		{
-			wprintw(swin, "0x%X: 0x%04X<-SP", i, MEMORY->stack[i]);
+			parse_operand(parser);
+			emit(parser, comparisons[i].op, -1);
+			return;
 		}
-		else { wprintw(swin,"0x%X: 0x%04X", i, MEMORY->stack[i]); }		
 	}
-	box(swin, 0 , 0);
-	wrefresh(swin);
 }
 
+static void parse_and(struct condition_parser *parser)
+{
+	parse_comparison(parser);
+	while (!parser->error && accept(parser, "&&"))
+	{
+		parse_comparison(parser);
+		emit(parser, COND_AND, -1);
+	}
+}
+
+static void parse_or(struct condition_parser *parser)
+{
+	parse_and(parser);
+	while (!parser->error && accept(parser, "||"))
+	{
+		parse_and(parser);
+		emit(parser, COND_OR, -1);
+	}
+}
 
-static void update_disas(WINDOW *dwin)
+/* Compile condition text, returns NULL (nothing allocated) on a syntax error or if it's too long */
+static struct debug_condition *compile_condition(const char *text)
 {
+	struct debug_condition *condition = calloc(1, sizeof(struct debug_condition));
+	if (condition == NULL) { return NULL; }
+
+	struct condition_parser parser = { .p = text, .condition = condition };
+	parse_or(&parser);
+	while (*parser.p == ' ') { parser.p++; }
+	if (parser.error || *parser.p != '\0' || parser.max_depth > CONDITION_STACK)
+	{
+		free(condition);
+		return NULL;
+	}
+	condition->code[parser.length] = COND_END;
+	snprintf(condition->text, sizeof(condition->text), "%s", text);
+	return condition;
+}
+
+/* Evaluate compiled breakpoint condition against machine (non-zero = true) */
+int debug_condition_holds(const struct debug_condition *condition, const struct Chip8Memory *machine)
+{
+	uint32_t stack[CONDITION_STACK];
+	int top = 0;
+
+	for (const uint8_t *code = condition->code;;)
+	{
+		switch (*code++) {
+			case COND_END: return stack[top - 1] != 0;
+			case COND_CONST: stack[top++] = code[0] | code[1] << 8; code += 2; break;
+			case COND_V: stack[top++] = machine->registers[*code++ & 0xF]; break;
+			case COND_I: stack[top++] = machine->index; break;
+			case COND_PC: stack[top++] = machine->pc; break;
+			case COND_SP: stack[top++] = machine->sp; break;
+			case COND_DT: stack[top++] = machine->delay_timer; break;
+			case COND_ST: stack[top++] = machine->sound_timer; break;
+			case COND_EQ: top--; stack[top - 1] = stack[top - 1] == stack[top]; break;
+			case COND_NE: top--; stack[top - 1] = stack[top - 1] != stack[top]; break;
+			case COND_LT: top--; stack[top - 1] = stack[top - 1] < stack[top]; break;
+			case COND_LE: top--; stack[top - 1] = stack[top - 1] <= stack[top]; break;
+			case COND_GT: top--; stack[top - 1] = stack[top - 1] > stack[top]; break;
+			case COND_GE: top--; stack[top - 1] = stack[top - 1] >= stack[top]; break;
+			case COND_AND: top--; stack[top - 1] = stack[top - 1] && stack[top]; break;
+			case COND_OR: top--; stack[top - 1] = stack[top - 1] || stack[top]; break;
+		}
+	}
+}
+
+static void set_condition(struct chip8_debug *debug, uint16_t address, struct debug_condition *condition)
+{
+	free(debug->conditions[address]);
+	debug->conditions[address] = condition;
+}
+
+
+/* Set/clear watch bits for [address, address + length) (wrapping at the end of RAM) */
+static void set_watch(struct chip8_debug *debug, uint64_t *watch, uint32_t address, uint32_t length, int enabled)
+{
+	for (uint32_t i = 0; i < length; i++)
+	{
+		uint32_t byte = (address + i) & (TOTAL_RAM - 1);
+		if (enabled) { watch[byte >> 6] |= 1ull << (byte & 63); }
+		else { watch[byte >> 6] &= ~(1ull << (byte & 63)); }
+	}
+	debug->watching = 0;
+	for (int i = 0; i < TOTAL_RAM / 64; i++) { debug->watching |= (debug->write_watch[i] | debug->read_watch[i]) != 0; }
+}
+
+
+static void update_disas(struct debug_view *view, struct Chip8Memory *machine)
+{
+	WINDOW *dwin = view->disas;
 	int row = 1;
 	int column = 1;
-	char results_buffer[25];
-	size_t results_size = sizeof(results_buffer);
+	char results_buffer[MNEMONIC_MAX];
+	char line[49]; // Window interior
+	uint16_t offset = (machine->pc - view->disas_start) & (TOTAL_RAM - 1);
+
+	if (!view->valid || offset >= DISAS_ROWS * 2 || (offset & 1)) { view->disas_start = machine->pc; } // PC scrolled off screen
+
+	for (int i = 0; i < DISAS_ROWS; i++)
+	{
+		uint16_t address = (view->disas_start + i * 2) & (TOTAL_RAM - 1);
+		uint16_t instruction = machine->ram[address] << 8u | machine->ram[(address + 1) & (TOTAL_RAM - 1)];
+		uint32_t shown = instruction | (uint32_t)address << 16 | (uint32_t)is_breakpoint(machine->debug, address) << 28 |
+			(uint32_t)(address == machine->pc) << 29;
+		if (view->valid && view->disas_rows[i] == shown) { continue; }
+
+		disassemble_instruction(results_buffer, sizeof(results_buffer), instruction);
+		snprintf(line, sizeof(line), "%c%c0x%03X: %s ; 0x%04X", (shown >> 28 & 1) ? '*' : ' ', (shown >> 29) ? '>' : ' ',
+			address, results_buffer, instruction);
+		mvwprintw(dwin, row+i, column, "%-*s", (int)sizeof(line) - 1, line);
+		view->disas_rows[i] = shown;
+	}
+	wnoutrefresh(dwin);
+}
+
+/* Repaint whatever changed in the windows and the status/command lines, with a single terminal write */
+static void redraw(struct debug_view *view, struct Chip8Memory *machine)
+{
+	wnoutrefresh(stdscr);
+	update_disas(view, machine);
+	update_registers(view, machine);
+	update_stack(view, machine);
+	view->valid = 1;
+	doupdate();
+}
 
-	for (int i = 0; i < 50; i+=2)
+#define DEBUG_HISTORY_SIZE (16u << 20) // Bytes of undo records for rstep/rcontinue (a few bytes per instruction)
+
+/* Tick timers between instructions, recording them for rstep */
+static void debug_tick(struct Chip8Memory *machine)
+{
+	if (machine->debug->history) { history_record_tick(machine->debug->history, machine); }
+	tick_timers(machine);
+}
+
+/* Run up to count instructions through the breakpoint loop of machine->debug, stopping early at a breakpoint/watch/finish
+* - *steps counts instructions since the debugger started; timers tick each time it reaches a multiple of CYCLES_PER_FRAME
+* - A call that stops without executing anything can't have crossed a frame boundary, so it never ticks
+* - Returns instructions executed, machine->debug->stop holds the reason (DEBUG_STOP_NONE = count reached)
+*/
+uint64_t debug_run(struct Chip8Memory *machine, uint64_t count, uint64_t *steps)
+{
+	struct chip8_debug *debug = machine->debug;
+	uint64_t executed = 0;
+
+	debug->stop = DEBUG_STOP_NONE;
+	while (executed < count)
 	{
-		wmove(dwin, row+(i/2), column);
-		wclrtoeol(dwin);
-		disassemble_instruction(results_buffer, results_size, (uint16_t)(MEMORY->ram[MEMORY->pc + i] << 8u | MEMORY->ram[MEMORY->pc + i + 1]));
-		wprintw(dwin, "0x%03X: %s ; 0x%04X", MEMORY->pc + i, results_buffer, (uint16_t)(MEMORY->ram[MEMORY->pc + i] << 8u | MEMORY->ram[MEMORY->pc + i + 1]));
+		uint64_t budget = CYCLES_PER_FRAME - (*steps % CYCLES_PER_FRAME);
+		if (budget > count - executed) { budget = count - executed; }
+
+		uint64_t done = execute_cycles(machine, budget);
+		*steps += done;
+		executed += done;
+		if (done && *steps % CYCLES_PER_FRAME == 0) { debug_tick(machine); }
+		if (debug->stop != DEBUG_STOP_NONE) { break; }
+	}
+	return executed;
+}
+
+#define DEBUG_POLL_FRAMES 64 // Emulated frames between input/display polls while running
+
+/* Print message on the status line under the command prompt */
+static void show_status(const char *format, ...)
+{
+	va_list arguments;
+	va_start(arguments, format);
+	move(31, 2);
+	clrtoeol();
+	vw_printw(stdscr, format, arguments);
+	va_end(arguments);
+}
+
+/* Parse hex address ("2A4" or "0x2A4"), returns -1 if missing/invalid/out of RAM */
+static int32_t parse_address(const char *text)
+{
+	char *end;
+	if (text == NULL || *text == '\0') { return -1; }
+	unsigned long address = strtoul(text, &end, 16);
+	if (*end != '\0' || address >= TOTAL_RAM) { return -1; }
+	return (int32_t)address;
+}
+
+/* Run machine at full speed until a breakpoint (whose condition holds)/watch/finish stop, a key in the terminal, or the SDL window closing
+* - Runs DEBUG_POLL_FRAMES frames at a time through debug_run() (timers still tick), polling SDL input/display in between
+* - With view->live, the windows are redrawn at most DEBUG_LIVE_HZ times a second, checked at those polls (never waits)
+* - Returns instructions executed, machine->debug->stop holds the reason (DEBUG_STOP_NONE = interrupted)
+*/
+static uint64_t run_to_stop(struct Chip8Memory *machine, struct debug_view *view, uint64_t *steps)
+{
+	struct chip8_debug *debug = machine->debug;
+	uint64_t executed = 0;
+	struct timespec now, next_redraw;
+	clock_gettime(CLOCK_MONOTONIC, &next_redraw);
+
+	nodelay(stdscr, TRUE);
+	debug->resume = 1;
+	while (1)
+	{
+		executed += debug_run(machine, DEBUG_POLL_FRAMES * CYCLES_PER_FRAME, steps);
+		if (debug->stop != DEBUG_STOP_NONE) { break; }
+
+		if (poll_input(machine) || getch() != ERR) { break; }
+		update(machine);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (view->live && (now.tv_sec > next_redraw.tv_sec || (now.tv_sec == next_redraw.tv_sec && now.tv_nsec >= next_redraw.tv_nsec)))
+		{
+			next_redraw.tv_nsec = now.tv_nsec + 1000000000L / DEBUG_LIVE_HZ;
+			next_redraw.tv_sec = now.tv_sec + next_redraw.tv_nsec / 1000000000L;
+			next_redraw.tv_nsec %= 1000000000L;
+			show_status("Running at 0x%03X, %llu instructions (any key to interrupt)", machine->pc, (unsigned long long)executed);
+			redraw(view, machine);
+		}
+		if (machine->key_wait) { struct timespec pause = { 0, 1000000 }; nanosleep(&pause, NULL); }
+	}
+	nodelay(stdscr, FALSE);
+	return executed;
+}
+
+/* Status line after run_to_stop() */
+static void show_stop(const struct Chip8Memory *machine, uint64_t executed)
+{
+	switch (machine->debug->stop) {
+		case DEBUG_STOP_BREAKPOINT:
+			show_status("Breakpoint at 0x%03X after %llu instructions", machine->pc, (unsigned long long)executed);
+			break;
+		case DEBUG_STOP_FINISH:
+			show_status("Returned to 0x%03X after %llu instructions", machine->pc, (unsigned long long)executed);
+			break;
+		case DEBUG_STOP_WATCH:
+			show_status("Watchpoint: %s 0x%03X by 0x%03X after %llu instructions", machine->debug->watch_write ? "write to" : "read of",
+				machine->debug->watch_address, machine->pc, (unsigned long long)executed);
+			break;
+		default:
+			show_status("Interrupted at 0x%03X after %llu instructions", machine->pc, (unsigned long long)executed);
 	}
-	box(dwin, 0 , 0);
-	wrefresh(dwin);
 }
 
 
-void cmd_debug()
+void cmd_debug(struct Chip8Memory *machine)
 {
 	initscr();
     raw();
@@ -317,6 +679,10 @@ void cmd_debug()
 
     int quit_loop = 0;
     int row, column;
+    uint64_t steps = 0; // Timers tick once every CYCLES_PER_FRAME steps (one emulated frame)
+    struct chip8_debug debug = { .finish_sp = DEBUG_FINISH_OFF }; // Breakpoints, checked by execute_cycles()
+    debug.history = history_create(DEBUG_HISTORY_SIZE); // rstep/rcontinue are unavailable if this fails
+    machine->debug = &debug;
 
     char *cmd_prefix = "> ";
     int prefix_length = strlen(cmd_prefix) + 2;
@@ -325,12 +691,11 @@ void cmd_debug()
     mvprintw(0, (COLS - strlen(title))/2, "%s", title);
     refresh();
 
-    WINDOW *disas_window = create_window(28, 50, 2, 2);
-	update_disas(disas_window);
-    WINDOW *register_window = create_window(21, 15, 2, 54);
-    update_registers(register_window);
-	WINDOW *stack_window = create_window(21, 18, 2, 70);
-	update_stack(stack_window);
+    struct debug_view view = { .live = 1 };
+    view.disas = create_window(28, 50, 2, 2);
+    view.registers = create_window(21, 15, 2, 54);
+    view.stack = create_window(21, 18, 2, 70);
+    redraw(&view, machine);
 	
 
     while(!quit_loop)
@@ -399,6 +764,7 @@ void cmd_debug()
 	            }
 	            break;
 	        default:
+	            if (command_length >= MAX_CMD_SIZE - 1) { break; } // Line full
 	            getyx(stdscr,row,column);
 	            insch(ch);
 	            move(row, column + 1);
@@ -415,17 +781,138 @@ void cmd_debug()
  		}
     	else if ((strncmp(command_string, "s\0", 2) == 0) || (strncmp(command_string, "step\0", 5) == 0))
     	{
-    		cycle();
-	        update();
-	        update_disas(disas_window);
-	        update_registers(register_window);
-	        update_stack(stack_window);
+    		debug.resume = 1; // Step off a breakpoint
+    		poll_input(machine);
+    		cycle(machine);
+    		if (++steps % CYCLES_PER_FRAME == 0) { debug_tick(machine); }
+    		show_status("");
+    	}
+    	else if ((strncmp(command_string, "rs\0", 3) == 0) || (strncmp(command_string, "rstep\0", 6) == 0))
+    	{
+    		if (debug.history == NULL || !history_undo(debug.history, machine)) { show_status("No history to step back into"); }
+    		else
+    		{
+    			steps--;
+    			show_status("Stepped back to 0x%03X (%llu instructions of history left)", machine->pc,
+    				(unsigned long long)history_count(debug.history));
+    		}
+    	}
+    	else if ((strncmp(command_string, "rc\0", 3) == 0) || (strncmp(command_string, "rcontinue\0", 10) == 0))
+    	{
+    		uint64_t undone = 0;
+    		int hit = 0;
+    		while (!hit && debug.history && history_undo(debug.history, machine))
+    		{
+    			steps--;
+    			undone++;
+    			uint16_t pc = machine->pc & (TOTAL_RAM - 1);
+    			hit = is_breakpoint(&debug, pc) && (debug.conditions[pc] == NULL || debug_condition_holds(debug.conditions[pc], machine));
+    		}
+    		if (hit) { show_status("Breakpoint at 0x%03X, %llu instructions back", machine->pc, (unsigned long long)undone); }
+    		else { show_status("Start of history at 0x%03X, %llu instructions back", machine->pc, (unsigned long long)undone); }
+    	}
+    	else if ((strncmp(command_string, "c\0", 2) == 0) || (strncmp(command_string, "continue\0", 9) == 0))
+    	{
+    		show_stop(machine, run_to_stop(machine, &view, &steps));
+    	}
+    	else if ((strncmp(command_string, "b ", 2) == 0) || (strncmp(command_string, "break ", 6) == 0))
+    	{
+    		char *condition_text = strstr(command_string, " if ");
+    		if (condition_text) { *condition_text = '\0'; condition_text += 4; }
+    		int32_t address = parse_address(strchr(command_string, ' ') + 1);
+    		struct debug_condition *condition = NULL;
+    		if (address < 0) { show_status("Usage: break ADDR [if COND] (hex, below 0x%03X)", TOTAL_RAM); }
+    		else if (condition_text && (condition = compile_condition(condition_text)) == NULL)
+    		{
+    			show_status("Bad condition '%s' (e.g. V3 == 0x10 && I > 0x300)", condition_text);
+    		}
+    		else
+    		{
+    			set_breakpoint(&debug, address, 1);
+    			set_condition(&debug, address, condition);
+    			if (condition) { show_status("Breakpoint set at 0x%03X if %s", address, condition->text); }
+    			else { show_status("Breakpoint set at 0x%03X", address); }
+    		}
+    	}
+    	else if ((strncmp(command_string, "d\0", 2) == 0) || (strncmp(command_string, "delete\0", 7) == 0))
+    	{
+    		memset(debug.breakpoints, 0, sizeof(debug.breakpoints));
+    		for (int address = 0; address < TOTAL_RAM; address++) { set_condition(&debug, address, NULL); }
+    		show_status("Deleted all breakpoints");
     	}
+    	else if ((strncmp(command_string, "d ", 2) == 0) || (strncmp(command_string, "delete ", 7) == 0))
+    	{
+    		int32_t address = parse_address(strchr(command_string, ' ') + 1);
+    		if (address < 0 || !is_breakpoint(&debug, address)) { show_status("No breakpoint at '%s'", strchr(command_string, ' ') + 1); }
+    		else
+    		{
+    			set_breakpoint(&debug, address, 0);
+    			set_condition(&debug, address, NULL);
+    			show_status("Deleted breakpoint at 0x%03X", address);
+    		}
+    	}
+    	else if ((strncmp(command_string, "watch ", 6) == 0) || (strncmp(command_string, "rwatch ", 7) == 0))
+    	{
+    		int write = command_string[0] == 'w';
+    		char *length_text = strchr(command_string, ':');
+    		unsigned long length = 1;
+    		if (length_text) { *length_text++ = '\0'; length = strtoul(length_text, NULL, 0); }
+    		int32_t address = parse_address(strchr(command_string, ' ') + 1);
+    		if (address < 0 || length == 0 || length > TOTAL_RAM)
+    		{
+    			show_status("Usage: %s ADDR[:LEN] (hex address below 0x%03X)", write ? "watch" : "rwatch", TOTAL_RAM);
+    		}
+    		else
+    		{
+    			set_watch(&debug, write ? debug.write_watch : debug.read_watch, address, length, 1);
+    			show_status("Watching %s 0x%03X-0x%03X", write ? "writes to" : "reads of", address, (address + length - 1) & (TOTAL_RAM - 1));
+    		}
+    	}
+    	else if (strncmp(command_string, "unwatch\0", 8) == 0)
+    	{
+    		set_watch(&debug, debug.write_watch, 0, TOTAL_RAM, 0);
+    		set_watch(&debug, debug.read_watch, 0, TOTAL_RAM, 0);
+    		show_status("Deleted all watchpoints");
+    	}
+    	else if ((strncmp(command_string, "u ", 2) == 0) || (strncmp(command_string, "until ", 6) == 0))
+    	{
+    		int32_t address = parse_address(strchr(command_string, ' ') + 1);
+    		if (address < 0) { show_status("Usage: until ADDR (hex, below 0x%03X)", TOTAL_RAM); }
+    		else
+    		{
+    			int temporary = !is_breakpoint(&debug, address);
+    			set_breakpoint(&debug, address, 1);
+    			show_stop(machine, run_to_stop(machine, &view, &steps));
+    			if (temporary) { set_breakpoint(&debug, address, 0); }
+    		}
+    	}
+    	else if ((strncmp(command_string, "f\0", 2) == 0) || (strncmp(command_string, "finish\0", 7) == 0))
+    	{
+    		if (machine->sp >= STACK_SIZE - 1) { show_status("Not in a subroutine"); }
+    		else
+    		{
+    			debug.finish_sp = machine->sp;
+    			show_stop(machine, run_to_stop(machine, &view, &steps));
+    			debug.finish_sp = DEBUG_FINISH_OFF;
+    		}
+    	}
+    	else if (strncmp(command_string, "live\0", 5) == 0)
+    	{
+    		view.live = !view.live;
+    		show_status("Live view while running %s", view.live ? "on" : "off");
+    	}
+    	else if (command_length) { show_status("Unknown command '%s'", command_string); }
+
+        update(machine);
+        redraw(&view, machine);
     }
 
-    destroy_window(stack_window);
-    destroy_window(register_window);
-    destroy_window(disas_window);
+    machine->debug = NULL;
+    history_destroy(debug.history);
+    for (int address = 0; address < TOTAL_RAM; address++) { set_condition(&debug, address, NULL); }
+    destroy_window(view.stack);
+    destroy_window(view.registers);
+    destroy_window(view.disas);
     endwin();
 }
 
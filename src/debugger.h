@@ -20,18 +20,60 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "chip8.h" // struct Chip8Memory
+
+#define MNEMONIC_MAX 27 // strlen("Unknown instruction: 0xFFFF")
+#define DEBUG_FINISH_OFF 0xFFFF // chip8_debug.finish_sp when not finishing a subroutine
+
+/* Why execute_cycles() returned early with a debugger attached */
+enum debug_stop{
+	DEBUG_STOP_NONE = 0,
+	DEBUG_STOP_BREAKPOINT, // PC reached a breakpoint (instruction not executed yet)
+	DEBUG_STOP_FINISH,     // RET popped the stack above finish_sp
+	DEBUG_STOP_WATCH,      // Instruction at PC is about to access a watched byte (not executed yet)
+};
+
+struct chip8_history; // history.h
+struct debug_condition; // Compiled "break ADDR if COND" expression (debugger.c)
+
+/* Run control checked by execute_cycles() while attached to machine->debug */
+struct chip8_debug{
+	uint64_t breakpoints[TOTAL_RAM / 64]; // Bit per RAM address
+	struct debug_condition *conditions[TOTAL_RAM]; // Per breakpoint address, NULL = unconditional (stops only if it holds)
+	uint64_t write_watch[TOTAL_RAM / 64]; // Bit per RAM address, checked by Fx55/Fx33
+	uint64_t read_watch[TOTAL_RAM / 64];  // Bit per RAM address, checked by Fx65/DRAW
+	uint8_t watching;     // Any watch bit set (otherwise the RAM-touching handlers aren't checked)
+	uint16_t finish_sp;   // Stop after a RET leaves sp above this (DEBUG_FINISH_OFF = never)
+	uint8_t resume;       // 1 = don't stop at a breakpoint/watch on the current PC (continuing from it)
+	uint8_t stop;         // enum debug_stop, set by execute_cycles()
+	uint16_t watch_address; // DEBUG_STOP_WATCH: first watched byte accessed
+	uint8_t watch_write;    // DEBUG_STOP_WATCH: 1 = write, 0 = read
+	struct chip8_history *history; // Undo records of executed instructions (NULL = not recorded)
+};
 
 
 /* Dump/print RAM (values and offset) */
-void dump_memory(uint16_t start_offset, uint16_t stop_offset); 
+void dump_memory(struct Chip8Memory *machine, uint16_t start_offset, uint16_t stop_offset);
 
-/* Disassemble single instruction and return result string in given buffer */
+/* 1 if instruction has a mnemonic (the disassembler doesn't print it as unknown) */
+int known_instruction(uint16_t instruction);
+
+/* Write mnemonic of instruction to out (at most MNEMONIC_MAX bytes, not null-terminated), returns length */
+size_t format_instruction(char out[], uint16_t instruction);
+
+/* Disassemble single instruction and return result string in given buffer (truncated to fit) */
 void disassemble_instruction(char results_buffer[], size_t buffer_size, uint16_t instruction);
 
 /* Print disassembly of given ROM */
 void disassemble_file(const char *path);
 
+/* Evaluate compiled breakpoint condition against machine (non-zero = true) */
+int debug_condition_holds(const struct debug_condition *condition, const struct Chip8Memory *machine);
+
+/* Run up to count instructions with machine->debug attached, ticking timers at frame boundaries, returns instructions executed */
+uint64_t debug_run(struct Chip8Memory *machine, uint64_t count, uint64_t *steps);
+
 /* Ncurses debugger */
-void cmd_debug();
+void cmd_debug(struct Chip8Memory *machine);
 
 #endif // POTATOCHIP_DEBUGGER
@@ -8,11 +8,23 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
 #include <SDL2/SDL.h>
-#include "chip8.h" // Chip8Memory *MEMORY, RAM_RESERVED_SIZE, TOTAL_RAM
+#include "chip8.h" // struct Chip8Memory, RAM_RESERVED_SIZE, TOTAL_RAM, FRAME_RATE
+#include "jit.h" // jit_execute()
+#include "savestate.h" // save_state(), load_state()
+#include "rewind.h" // rewind_capture(), rewind_step()
+#include "profile.h" // struct chip8_profile
 #include "emulator.h"
 
 
+#define PRESENT_INTERVAL_MS 16 // ~60Hz host frame
+#define FRAME_NS (1000000000L / FRAME_RATE) // Emulated frame period
+#define MAX_FRAME_LAG 4 // Frames the host may fall behind before pacing resyncs
+
+
 struct sdl_window {
 	SDL_Renderer *renderer;
 	SDL_Window *window;
@@ -21,9 +33,9 @@ struct sdl_window {
 
 
 /* Initialize CHIP-8 memory and display */
-int initialize_emulator(int scale)
+int initialize_emulator(struct Chip8Memory *machine, int scale)
 {
-	if (initialize_memory() != 0) { return -1; }
+	if (initialize_memory(machine) != 0) { return -1; }
 
 	if (SDL_Init(SDL_INIT_VIDEO) < 0)
 	{
@@ -45,7 +57,7 @@ int initialize_emulator(int scale)
 
 
 /* Read bytes from given ROM file into RAM */
-int loadROM(const char *path)
+int loadROM(struct Chip8Memory *machine, const char *path)
 {
 	FILE *ROMfp = fopen(path, "r");
 	if (ROMfp == NULL)
@@ -53,171 +65,280 @@ int loadROM(const char *path)
 		printf("Error opening file '%s'\n", path);
 		return -1;
 	}
-	fread(MEMORY->ram + MEMORY->pc, 1, TOTAL_RAM - RAM_RESERVED_SIZE, ROMfp); // MEMORY must be initialized first
+	size_t bytes_read = fread(machine->ram + machine->pc, 1, TOTAL_RAM - RAM_RESERVED_SIZE, ROMfp); // machine must be initialized first
 	fclose(ROMfp);
+	invalidate_decoded(machine, machine->pc, bytes_read);
 	return 0;
 }
 
 
-void update()
+/* Copy ROM image already in host memory into RAM */
+int loadROMData(struct Chip8Memory *machine, const uint8_t *data, size_t size)
 {
-	SDL_UpdateTexture(emu_window.texture, NULL, MEMORY->screen, (sizeof(MEMORY->screen[0]) * SCREEN_WIDTH));
-	SDL_RenderClear(emu_window.renderer);
-	SDL_RenderCopy(emu_window.renderer, emu_window.texture, NULL, NULL);
-	SDL_RenderPresent(emu_window.renderer);
+	if (size > TOTAL_RAM - RAM_RESERVED_SIZE)
+	{
+		printf("ROM too large (%zu bytes)\n", size);
+		return -1;
+	}
+	memcpy(machine->ram + machine->pc, data, size); // machine must be initialized first
+	invalidate_decoded(machine, machine->pc, size);
+	return 0;
 }
 
 
-int process_input()
+/* Expand dirty 1-bit screen rows to RGBA8888, upload only those rows, and present
+* - Does nothing if no row changed since the last call
+*/
+void update(struct Chip8Memory *machine)
 {
-	int quit = 0;
-	SDL_Event event;
+	static uint32_t pixels[SCREEN_WIDTH * SCREEN_HEIGHT];
+	uint32_t dirty = machine->dirty_rows;
+	if (dirty == 0) { return; }
 
-	while (SDL_PollEvent(&event))
+	int top = __builtin_ctz(dirty);
+	int bottom = 31 - __builtin_clz(dirty);
+	for (int y = top; y <= bottom; y++)
 	{
-		switch (event.type){
-			case SDL_QUIT:
-				quit = 1;
-				break;
+		uint64_t row = machine->screen[y];
+		for (unsigned int x = 0; x < SCREEN_WIDTH; x++)
+		{
+			pixels[y * SCREEN_WIDTH + x] = (row & (0x8000000000000000ull >> x)) ? 0xFFFFFFFF : 0x00000000;
+		}
+	}
 
-			case SDL_KEYDOWN:
-				switch (event.key.keysym.sym)
-				{
-					case SDLK_ESCAPE:
-						quit = 1; break;
-					 	
-					case SDLK_x:
-						MEMORY->keypad[0] = 1; break;
+	SDL_Rect rows = { 0, top, SCREEN_WIDTH, bottom - top + 1 };
+	SDL_UpdateTexture(emu_window.texture, &rows, &pixels[top * SCREEN_WIDTH], (sizeof(pixels[0]) * SCREEN_WIDTH));
+	SDL_RenderClear(emu_window.renderer);
+	SDL_RenderCopy(emu_window.renderer, emu_window.texture, NULL, NULL);
+	SDL_RenderPresent(emu_window.renderer);
+	machine->dirty_rows = 0;
+}
 
-					case SDLK_1:
-						MEMORY->keypad[1] = 1; break;
 
-					case SDLK_2:
-						MEMORY->keypad[2] = 1; break;
+/* Host key (by scancode, i.e. physical position) -> keypad key, -1 if unmapped */
+static int8_t keymap[SDL_NUM_SCANCODES] = {
+	[0 ... SDL_NUM_SCANCODES - 1] = -1,
+	[SDL_SCANCODE_1] = 0x1, [SDL_SCANCODE_2] = 0x2, [SDL_SCANCODE_3] = 0x3, [SDL_SCANCODE_4] = 0xC,
+	[SDL_SCANCODE_Q] = 0x4, [SDL_SCANCODE_W] = 0x5, [SDL_SCANCODE_E] = 0x6, [SDL_SCANCODE_R] = 0xD,
+	[SDL_SCANCODE_A] = 0x7, [SDL_SCANCODE_S] = 0x8, [SDL_SCANCODE_D] = 0x9, [SDL_SCANCODE_F] = 0xE,
+	[SDL_SCANCODE_Z] = 0xA, [SDL_SCANCODE_X] = 0x0, [SDL_SCANCODE_C] = 0xB, [SDL_SCANCODE_V] = 0xF,
+};
 
-					case SDLK_3:
-						MEMORY->keypad[3] = 1; break;
+static const char *state_file; // F5/F9 save state slot (NULL = hotkeys disabled)
+static struct rewind_buffer *history; // Frame history (NULL = no rewind)
+static int rewinding; // Backspace held: step back one frame per frame
 
-					case SDLK_q:
-						MEMORY->keypad[4] = 1; break;
+/* Delay between SDL timestamping a key event and the keypad seeing it */
+static struct {
+	uint64_t events;
+	uint64_t total_ms;
+	uint32_t max_ms;
+} input_latency;
 
-					case SDLK_w:
-						MEMORY->keypad[5] = 1; break;
 
-					case SDLK_e:
-						MEMORY->keypad[6] = 1; break;
+/* Replace the default keymap with "SCANCODE_NAME KEY" lines from file
+* - SCANCODE_NAME is an SDL scancode name ("X", "Keypad 7", "Left Shift", ...)
+* - KEY is the keypad key in hex (0 - F)
+* - Blank lines and lines starting with '#' are ignored
+*/
+int load_keymap(const char *path)
+{
+	FILE *fp = fopen(path, "r");
+	if (fp == NULL)
+	{
+		printf("Error opening keymap '%s'\n", path);
+		return -1;
+	}
 
-					case SDLK_a:
-						MEMORY->keypad[7] = 1; break;
+	int8_t map[SDL_NUM_SCANCODES];
+	memset(map, -1, sizeof(map));
 
-					case SDLK_s:
-						MEMORY->keypad[8] = 1; break;
+	char line[128];
+	int line_number = 0;
+	while (fgets(line, sizeof(line), fp))
+	{
+		line_number++;
+		size_t length = strcspn(line, "\r\n");
+		while (length > 0 && (line[length - 1] == ' ' || line[length - 1] == '\t')) { length--; }
+		line[length] = '\0';
+		if (length == 0 || line[0] == '#') { continue; }
+
+		char *key = strrchr(line, ' ');
+		char *tab = strrchr(line, '\t');
+		if (tab > key) { key = tab; }
+
+		char *end = NULL;
+		long value = key ? strtol(key + 1, &end, 16) : -1;
+		if (key) { while (key > line && (key[-1] == ' ' || key[-1] == '\t')) { key--; } *key = '\0'; }
+
+		SDL_Scancode scancode = key ? SDL_GetScancodeFromName(line) : SDL_SCANCODE_UNKNOWN;
+		if (scancode == SDL_SCANCODE_UNKNOWN || end == NULL || *end != '\0' || value < 0 || value > 0xF)
+		{
+			printf("Invalid keymap entry on line %d of '%s'\n", line_number, path);
+			fclose(fp);
+			return -1;
+		}
+		map[scancode] = (int8_t)value;
+	}
+	fclose(fp);
 
-					case SDLK_d:
-						MEMORY->keypad[9] = 1; break;
+	memcpy(keymap, map, sizeof(keymap));
+	return 0;
+}
 
-					case SDLK_z:
-						MEMORY->keypad[0xA] = 1; break;
 
-					case SDLK_c:
-						MEMORY->keypad[0xB] = 1; break;
+/* Set file used by the F5 (save state) and F9 (load state) hotkeys */
+void set_state_file(const char *path)
+{
+	state_file = path;
+}
 
-					case SDLK_4:
-						MEMORY->keypad[0xC] = 1; break;
 
-					case SDLK_r:
-						MEMORY->keypad[0xD] = 1; break;
+/* Record every frame into rewind, played back while Backspace is held (NULL disables) */
+void set_rewind_buffer(struct rewind_buffer *rewind)
+{
+	history = rewind;
+}
 
-					case SDLK_f:
-						MEMORY->keypad[0xE] = 1; break;
 
-					case SDLK_v:
-						MEMORY->keypad[0xF] = 1; break;
-				}
+/* Drain pending SDL events into the keypad bitmask, returns 1 on quit
+* - Called once per emulated frame, before the frame's instructions run
+* - F5 saves, F9 restores the machine through the state file (see set_state_file())
+* - Backspace rewinds while held (see set_rewind_buffer())
+*/
+static int process_input(struct Chip8Memory *machine)
+{
+	int quit = 0;
+	SDL_Event event;
+
+	while (SDL_PollEvent(&event))
+	{
+		switch (event.type){
+			case SDL_QUIT:
+				quit = 1;
 				break;
 
+			case SDL_KEYDOWN:
 			case SDL_KEYUP:
-				switch (event.key.keysym.sym)
+				if (event.key.keysym.scancode == SDL_SCANCODE_ESCAPE) { quit = 1; break; }
+				if (event.key.keysym.scancode == SDL_SCANCODE_BACKSPACE && history)
 				{
-					case SDLK_x:
-						MEMORY->keypad[0] = 0; break;
-
-					case SDLK_1:
-						MEMORY->keypad[1] = 0; break;
-
-					case SDLK_2:
-						MEMORY->keypad[2] = 0; break;
-
-					case SDLK_3:
-						MEMORY->keypad[3] = 0; break;
-
-					case SDLK_q:
-						MEMORY->keypad[4] = 0; break;
-
-					case SDLK_w:
-						MEMORY->keypad[5] = 0; break;
-
-					case SDLK_e:
-						MEMORY->keypad[6] = 0; break;
-
-					case SDLK_a:
-						MEMORY->keypad[7] = 0; break;
-
-					case SDLK_s:
-						MEMORY->keypad[8] = 0; break;
-
-					case SDLK_d:
-						MEMORY->keypad[9] = 0; break;
+					rewinding = (event.type == SDL_KEYDOWN);
+					break;
+				}
+				if (event.type == SDL_KEYDOWN && !event.key.repeat && state_file &&
+					(event.key.keysym.scancode == SDL_SCANCODE_F5 || event.key.keysym.scancode == SDL_SCANCODE_F9))
+				{
+					if (event.key.keysym.scancode == SDL_SCANCODE_F5)
+					{
+						if (save_state(machine, state_file) == 0) { printf("Saved state to '%s'\n", state_file); }
+					}
+					else if (load_state(machine, state_file) == 0) { printf("Loaded state from '%s'\n", state_file); }
+					break;
+				}
+				if (event.key.repeat || (unsigned int)event.key.keysym.scancode >= SDL_NUM_SCANCODES) { break; }
 
-					case SDLK_z:
-						MEMORY->keypad[0xA] = 0; break;
+				int8_t key = keymap[event.key.keysym.scancode];
+				if (key < 0) { break; }
+				set_key(machine, (uint8_t)key, event.type == SDL_KEYDOWN);
 
-					case SDLK_c:
-						MEMORY->keypad[0xB] = 0; break;
+				uint32_t delay = SDL_GetTicks() - event.key.timestamp;
+				input_latency.events++;
+				input_latency.total_ms += delay;
+				if (delay > input_latency.max_ms) { input_latency.max_ms = delay; }
+				break;
+		}
+	}
+	return quit;
+}
 
-					case SDLK_4:
-						MEMORY->keypad[0xC] = 0; break;
 
-					case SDLK_r:
-						MEMORY->keypad[0xD] = 0; break;
+/* Drain pending SDL events into machine's keypad (and hotkeys), returns 1 on quit */
+int poll_input(struct Chip8Memory *machine)
+{
+	return process_input(machine);
+}
 
-					case SDLK_f:
-						MEMORY->keypad[0xE] = 0; break;
 
-					case SDLK_v:
-						MEMORY->keypad[0xF] = 0; break;
-				}
-				break;
-		}
+/* Advance an absolute CLOCK_MONOTONIC deadline by ns nanoseconds */
+static void advance_deadline(struct timespec *deadline, long ns)
+{
+	deadline->tv_nsec += ns;
+	while (deadline->tv_nsec >= 1000000000L)
+	{
+		deadline->tv_nsec -= 1000000000L;
+		deadline->tv_sec++;
 	}
-	return quit;
 }
 
 
-void start_emulator()
+/* Start main loop
+* - Each 60Hz frame: poll input (see process_input()), execute cycles_per_frame instructions, tick timers once,
+*   record the frame for rewind; or, while rewinding, restore the previous frame instead
+* - Frames are paced against absolute deadlines (no drift from oversleeping);
+*   if the host falls more than MAX_FRAME_LAG frames behind, the schedule restarts from now
+* - turbo runs frames back to back without sleeping
+* - While the machine is parked on WAIT_KEY, the wait for the next frame blocks on SDL
+*   events instead, so the key press lands in the keypad immediately
+* - The screen is presented at most once per host frame, and only if CLS/DRAW changed it
+*/
+void start_emulator(struct Chip8Memory *machine, uint32_t cycles_per_frame, int turbo)
 {
-	
 	int quit = 0;
-	uint32_t total_cycles = 0;
+	uint32_t last_present = 0;
+	struct timespec deadline, now;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
 
 	while (!quit)
 	{
-		quit = process_input();
-		cycle();
+		quit = process_input(machine);
+		if (rewinding) { rewind_step(history, machine, 1); }
+		else
+		{
+			if (machine->jit) { jit_execute(machine, cycles_per_frame); }
+			else { execute_cycles(machine, cycles_per_frame); }
+			tick_timers(machine);
+			if (machine->profile) { machine->profile->frames++; }
+			if (history) { rewind_capture(history, machine); }
+		}
 
-		if(total_cycles % 9 == 0)
+		if (machine->dirty_rows && (SDL_GetTicks() - last_present) >= PRESENT_INTERVAL_MS)
 		{
-			update();
+			update(machine);
+			last_present = SDL_GetTicks();
 		}
+
+		if (turbo)
+		{
+			if (machine->key_wait) { SDL_WaitEventTimeout(NULL, FRAME_NS / 1000000L); } // Don't spin frames while parked on WAIT_KEY
+			continue;
+		}
+
+		advance_deadline(&deadline, FRAME_NS);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		long long behind = (long long)(now.tv_sec - deadline.tv_sec) * 1000000000LL + (now.tv_nsec - deadline.tv_nsec);
+		if (behind > (long long)MAX_FRAME_LAG * FRAME_NS) { deadline = now; continue; } // Host stalled, don't burst to catch up
+
+		if (machine->key_wait && behind < -1000000LL) // Parked on WAIT_KEY: block in SDL so a key press is taken as soon as it arrives
+		{
+			if (SDL_WaitEventTimeout(NULL, (int)(-behind / 1000000LL)) && process_input(machine)) { break; }
+		}
+
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {}
 	}
 
+	if (input_latency.events)
+	{
+		printf("Input latency: %llu key events, avg %.2f ms, max %u ms (event to keypad)\n",
+			(unsigned long long)input_latency.events, (double)input_latency.total_ms / input_latency.events, input_latency.max_ms);
+	}
+	if (history) { print_rewind_stats(history); }
 }
 
 
 /* Destroy/free CHIP-8 memory, displays, etc. */
 void shutdown_emulator()
 {
-	release_memory();
 	SDL_DestroyTexture(emu_window.texture);
     SDL_DestroyRenderer(emu_window.renderer);
     SDL_DestroyWindow(emu_window.window);
@@ -226,16 +347,7 @@ void shutdown_emulator()
 
 
 /* Fetch, decode, execute instruction */
-void cycle()
+void cycle(struct Chip8Memory *machine)
 {
-	if (MEMORY->delay_timer > 0) { MEMORY->delay_timer--; }
-	if (MEMORY->sound_timer > 0) { MEMORY->sound_timer--; }
-	if (MEMORY->sound_timer) { /* Beep I didn't impliment */ }
-
-	// Get instruction and increment PC
-	MEMORY->ir = (uint16_t)(MEMORY->ram[MEMORY->pc] << 8u | MEMORY->ram[MEMORY->pc + 1]);
-	MEMORY->pc += 0x0002;
-
-	// Decode and execute
-	execute();
+	execute_cycles(machine, 1);
 }
@@ -9,23 +9,42 @@
 #define POTATOCHIP_EMULATOR
 
 #include <stdint.h>
+#include <stddef.h>
+#include "chip8.h" // struct Chip8Memory
+#include "rewind.h" // struct rewind_buffer
 
 
 /* Initialize CHIP-8 memory and display */
-int initialize_emulator(int scale);
+int initialize_emulator(struct Chip8Memory *machine, int scale);
 
 /* Read bytes from CHIP-8 ROM file into initialized RAM */
-int loadROM(const char *path);
+int loadROM(struct Chip8Memory *machine, const char *path);
 
-void update();
+/* Copy ROM image already in host memory into initialized RAM */
+int loadROMData(struct Chip8Memory *machine, const uint8_t *data, size_t size);
 
-/* Start main loop */
-void start_emulator();
+/* Replace the default keymap with "SCANCODE_NAME KEY" lines from file */
+int load_keymap(const char *path);
+
+/* Set file used by the F5 (save state) and F9 (load state) hotkeys */
+void set_state_file(const char *path);
+
+/* Record every frame into rewind, played back while Backspace is held (NULL disables) */
+void set_rewind_buffer(struct rewind_buffer *rewind);
+
+/* Drain pending SDL events into machine's keypad (and hotkeys), returns 1 on quit */
+int poll_input(struct Chip8Memory *machine);
+
+/* Copy changed rows of machine screen to the SDL window, present if anything changed */
+void update(struct Chip8Memory *machine);
+
+/* Start main loop, cycles_per_frame instructions per 60Hz frame (turbo: no pacing) */
+void start_emulator(struct Chip8Memory *machine, uint32_t cycles_per_frame, int turbo);
 
 /* Destroy/free CHIP-8 memory, displays, etc. */
 void shutdown_emulator();
 
 /* Fetch, decode, execute instruction */
-void cycle();
+void cycle(struct Chip8Memory *machine);
 
 #endif // POTATOCHIP_EMULATOR
@@ -0,0 +1,388 @@
+/*
+* PotatoCHIP-8 - ROM Farm
+*
+* Runs a ROM list (or ROM x input script matrix) as
+* independent headless machines spread over worker
+* threads. Every worker owns a deque of jobs and pops
+* from its tail; idle workers steal from the head of
+* other workers' deques, so uneven job lengths still
+* keep every core busy.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "chip8.h" // struct Chip8Memory
+#include "emulator.h" // loadROMData()
+#include "headless.h" // run_machine(), machine_hash(), input scripts
+#include "jit.h" // jit_create(), jit_attach()
+#include "farm.h"
+
+
+struct rom_image{
+	const char *path;
+	uint8_t *data;
+	size_t size;
+};
+
+struct farm_job{
+	size_t rom;       // Index into farm.roms
+	size_t script;    // Index into farm.scripts (unused if no scripts)
+	int status;       // 0 = ok, -1 = failed to load, -2 = JIT lockstep divergence, -3 = not run (no worker could start)
+	uint64_t executed; // Instructions actually run
+	uint64_t skipped;  // Instructions fast-forwarded (idle loops, WAIT_KEY)
+	uint64_t hash;
+	double seconds;
+};
+
+/* Jobs [head, tail) not yet taken. Owner pops tail, thieves take head */
+struct job_deque{
+	pthread_mutex_t lock;
+	size_t *jobs;
+	size_t head;
+	size_t tail;
+};
+
+struct farm{
+	struct rom_image *roms;
+	size_t rom_count;
+	char **script_paths;
+	struct input_script *scripts;
+	size_t script_count;
+	struct farm_job *jobs;
+	size_t job_count;
+	struct job_deque *deques;
+	int threads;
+	uint64_t cycles;
+	uint32_t cycles_per_frame;
+	uint64_t seed;
+	enum core_mode core;
+};
+
+struct worker{
+	struct farm *farm;
+	int id;
+	pthread_t thread;
+	uint64_t jobs_run;
+	uint64_t steals;
+};
+
+
+/* Read non-empty, non-comment lines of a file into a NULL-terminated array of strings */
+char **read_list_file(const char *path, size_t *count)
+{
+	*count = 0;
+	FILE *listfp = fopen(path, "r");
+	if (listfp == NULL)
+	{
+		printf("Error opening list '%s'\n", path);
+		return NULL;
+	}
+
+	size_t capacity = 16;
+	char **list = malloc((capacity + 1) * sizeof(char *));
+	if (list == NULL) { fclose(listfp); return NULL; }
+
+	char line[4096];
+	while (fgets(line, sizeof(line), listfp) != NULL)
+	{
+		line[strcspn(line, "\r\n")] = '\0';
+		char *start = line + strspn(line, " \t");
+		if (*start == '#' || *start == '\0') { continue; }
+
+		if (*count == capacity)
+		{
+			capacity *= 2;
+			char **grown = realloc(list, (capacity + 1) * sizeof(char *));
+			if (grown == NULL) { list[*count] = NULL; free_list(list); fclose(listfp); return NULL; }
+			list = grown;
+		}
+		if ((list[*count] = strdup(start)) == NULL) { free_list(list); fclose(listfp); return NULL; }
+		(*count)++;
+	}
+	list[*count] = NULL;
+	fclose(listfp);
+	return list;
+}
+
+
+/* Free array returned by read_list_file() */
+void free_list(char **list)
+{
+	if (list == NULL) { return; }
+	for (size_t i = 0; list[i]; i++) { free(list[i]); }
+	free(list);
+}
+
+
+/* Read whole ROM into host memory once, so jobs only memcpy it */
+static int read_rom_image(const char *path, struct rom_image *image)
+{
+	image->path = path;
+	image->data = NULL;
+	image->size = 0;
+
+	FILE *ROMfp = fopen(path, "r");
+	if (ROMfp == NULL) { return -1; }
+
+	image->data = malloc(TOTAL_RAM);
+	if (image->data == NULL) { fclose(ROMfp); return -1; }
+	image->size = fread(image->data, 1, TOTAL_RAM - RAM_RESERVED_SIZE, ROMfp);
+	fclose(ROMfp);
+	return 0;
+}
+
+
+/* Take next job: own deque tail first, then steal from other deques' heads */
+static int take_job(struct worker *self, size_t *job)
+{
+	struct farm *farm = self->farm;
+
+	for (int i = 0; i < farm->threads; i++)
+	{
+		struct job_deque *deque = &farm->deques[(self->id + i) % farm->threads];
+		int found = 0;
+
+		pthread_mutex_lock(&deque->lock);
+		if (deque->head < deque->tail)
+		{
+			*job = (i == 0) ? deque->jobs[--deque->tail] : deque->jobs[deque->head++];
+			found = 1;
+		}
+		pthread_mutex_unlock(&deque->lock);
+
+		if (found)
+		{
+			if (i != 0) { self->steals++; }
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+static void run_job(struct farm *farm, struct Chip8Memory *machine, struct chip8_jit *jit, struct farm_job *job)
+{
+	struct rom_image *rom = &farm->roms[job->rom];
+	const struct input_script *script = farm->script_count ? &farm->scripts[job->script] : NULL;
+
+	if (rom->data == NULL || initialize_memory(machine) != 0 || loadROMData(machine, rom->data, rom->size) != 0)
+	{
+		job->status = -1;
+		return;
+	}
+	seed_rng(machine, farm->seed); // Same seed for every job: hashes depend only on ROM, script, and budget
+	if (jit) { jit_attach(jit, machine); }
+
+	struct timespec start, stop;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	job->executed = run_machine(machine, script, farm->cycles, farm->cycles_per_frame, NULL, &job->skipped);
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	job->seconds = elapsed_seconds(&start, &stop);
+	job->hash = machine_hash(machine);
+	job->status = (jit && jit_diverged(jit)) ? -2 : 0;
+}
+
+
+static void *worker_main(void *arg)
+{
+	struct worker *self = arg;
+	struct Chip8Memory *machine = malloc(sizeof(struct Chip8Memory)); // One machine per worker, reused for every job
+	if (machine == NULL) { printf("Worker %d: error allocating machine\n", self->id); return NULL; }
+
+	struct chip8_jit *jit = NULL; // One JIT per worker, re-attached for every job
+	if (self->farm->core != CORE_INTERP)
+	{
+		jit = jit_create(self->farm->core == CORE_JIT_LOCKSTEP);
+		if (jit == NULL) { printf("Worker %d: error creating JIT\n", self->id); free(machine); return NULL; }
+	}
+
+	size_t job;
+	while (take_job(self, &job))
+	{
+		run_job(self->farm, machine, jit, &self->farm->jobs[job]);
+		self->jobs_run++;
+	}
+
+	jit_destroy(jit);
+	free(machine);
+	return NULL;
+}
+
+
+/* Build the ROM (x script) job matrix and split it into contiguous per-worker deques */
+static int build_jobs(struct farm *farm)
+{
+	size_t scripts = farm->script_count ? farm->script_count : 1;
+	farm->job_count = farm->rom_count * scripts;
+	farm->jobs = calloc(farm->job_count, sizeof(struct farm_job));
+	farm->deques = calloc(farm->threads, sizeof(struct job_deque));
+	if (farm->jobs == NULL || farm->deques == NULL) { return -1; }
+
+	for (size_t i = 0; i < farm->job_count; i++)
+	{
+		farm->jobs[i].rom = i / scripts;
+		farm->jobs[i].script = i % scripts;
+		farm->jobs[i].status = -3; // Until a worker runs it
+	}
+
+	for (int t = 0; t < farm->threads; t++)
+	{
+		struct job_deque *deque = &farm->deques[t];
+		size_t first = (farm->job_count * t) / farm->threads;
+		size_t last = (farm->job_count * (t + 1)) / farm->threads;
+
+		pthread_mutex_init(&deque->lock, NULL);
+		deque->jobs = malloc((last - first + 1) * sizeof(size_t));
+		if (deque->jobs == NULL) { return -1; }
+		for (size_t j = first; j < last; j++) { deque->jobs[j - first] = j; }
+		deque->head = 0;
+		deque->tail = last - first;
+	}
+	return 0;
+}
+
+
+static void print_results(const struct farm *farm, const struct worker *workers, double wall_seconds)
+{
+	uint64_t total_executed = 0;
+	uint64_t total_skipped = 0;
+	uint64_t steals = 0;
+	size_t failed = 0;
+
+	for (size_t i = 0; i < farm->job_count; i++)
+	{
+		const struct farm_job *job = &farm->jobs[i];
+		const char *script = farm->script_count ? farm->script_paths[job->script] : "-";
+
+		if (job->status == -1 || job->status == -3)
+		{
+			printf("job=%zu rom=%s script=%s status=%s\n", i, farm->roms[job->rom].path, script, (job->status == -1) ? "error" : "not-run");
+			failed++;
+			continue;
+		}
+		if (job->status == -2) { failed++; }
+		printf("job=%zu rom=%s script=%s status=%s instructions=%llu skipped=%llu seconds=%.6f ips=%.0f hash=%016llx\n",
+			i, farm->roms[job->rom].path, script, (job->status == 0) ? "ok" : "diverged", (unsigned long long)job->executed,
+			(unsigned long long)job->skipped, job->seconds, (job->seconds > 0) ? (double)job->executed / job->seconds : 0.0, (unsigned long long)job->hash);
+		total_executed += job->executed;
+		total_skipped += job->skipped;
+	}
+	for (int t = 0; t < farm->threads; t++) { steals += workers[t].steals; }
+
+	printf("\nJobs:             %zu (%zu failed)\n", farm->job_count, failed);
+	printf("Threads:          %d\n", farm->threads);
+	printf("Steals:           %llu\n", (unsigned long long)steals);
+	printf("Seed:             %llu\n", (unsigned long long)farm->seed);
+	printf("Instructions:     %llu\n", (unsigned long long)total_executed);
+	printf("Fast-forwarded:   %llu\n", (unsigned long long)total_skipped);
+	printf("Elapsed:          %.6f s\n", wall_seconds);
+	printf("Instructions/sec: %.0f\n", (wall_seconds > 0) ? (double)total_executed / wall_seconds : 0.0);
+}
+
+
+static void release_farm(struct farm *farm)
+{
+	for (size_t i = 0; i < farm->rom_count; i++) { free(farm->roms[i].data); }
+	for (size_t i = 0; i < farm->script_count; i++) { free_input_script(&farm->scripts[i]); }
+	if (farm->deques)
+	{
+		for (int t = 0; t < farm->threads; t++)
+		{
+			free(farm->deques[t].jobs);
+			pthread_mutex_destroy(&farm->deques[t].lock);
+		}
+	}
+	free(farm->roms);
+	free(farm->scripts);
+	free(farm->jobs);
+	free(farm->deques);
+}
+
+
+/* Run every ROM in rom_list (x every input script in script_list, if given) headless on worker threads
+* - threads <= 0 uses one worker per online CPU
+* - Budget per job is options->cycles instructions, or frames * cycles_per_frame
+* - options->core selects the interpreter or the JIT (one JIT per worker)
+* - Fails if any job was left unrun because no worker could start
+*/
+int run_farm(const char *rom_list, const char *script_list, int threads, const struct run_options *options)
+{
+	uint64_t cycles = options->frames ? options->frames * options->cycles_per_frame : options->cycles;
+	if (cycles == 0)
+	{
+		puts("Farm mode requires --cycles or --frames");
+		return -1;
+	}
+	if (threads <= 0) { threads = (int)sysconf(_SC_NPROCESSORS_ONLN); }
+	if (threads <= 0) { threads = 1; }
+
+	int status = -1;
+	struct farm farm = {0};
+	char **rom_paths = read_list_file(rom_list, &farm.rom_count);
+	if (rom_paths == NULL || farm.rom_count == 0) { puts("No ROMs to run."); goto out; }
+	if (script_list)
+	{
+		farm.script_paths = read_list_file(script_list, &farm.script_count);
+		if (farm.script_paths == NULL || farm.script_count == 0) { puts("No input scripts to run."); goto out; }
+	}
+
+	farm.roms = calloc(farm.rom_count, sizeof(struct rom_image));
+	farm.scripts = calloc(farm.script_count ? farm.script_count : 1, sizeof(struct input_script));
+	if (farm.roms == NULL || farm.scripts == NULL) { goto out; }
+
+	for (size_t i = 0; i < farm.rom_count; i++)
+	{
+		if (read_rom_image(rom_paths[i], &farm.roms[i]) != 0) { printf("Error reading ROM '%s'\n", rom_paths[i]); }
+	}
+	for (size_t i = 0; i < farm.script_count; i++)
+	{
+		if (load_input_script(farm.script_paths[i], &farm.scripts[i]) != 0) { goto out; }
+	}
+
+	farm.threads = threads;
+	farm.cycles = cycles;
+	farm.cycles_per_frame = options->cycles_per_frame;
+	farm.seed = options->seed;
+	farm.core = options->core;
+	if (build_jobs(&farm) != 0) { puts("Error allocating jobs."); goto out; }
+
+	struct worker *workers = calloc(threads, sizeof(struct worker));
+	if (workers == NULL) { goto out; }
+
+	struct timespec start, stop;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	int started = 0;
+	for (; started < threads; started++)
+	{
+		workers[started].farm = &farm;
+		workers[started].id = started;
+		if (pthread_create(&workers[started].thread, NULL, worker_main, &workers[started]) != 0) { break; }
+	}
+	if (started == 0) { worker_main(&workers[0]); } // Couldn't spawn threads, run jobs inline (worker 0 steals the rest)
+	for (int t = 0; t < started; t++) { pthread_join(workers[t].thread, NULL); }
+
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	print_results(&farm, workers, elapsed_seconds(&start, &stop));
+	free(workers);
+	status = 0;
+	for (size_t i = 0; i < farm.job_count; i++)
+	{
+		if (farm.jobs[i].status == -3) { puts("No worker could start, some jobs were not run."); status = -1; break; }
+	}
+
+out:
+	release_farm(&farm);
+	free_list(farm.script_paths);
+	free_list(rom_paths);
+	return status;
+}
@@ -0,0 +1,29 @@
+/*
+* PotatoCHIP-8 - ROM Farm Header
+*
+* Batch runner for many headless machines across worker threads
+*/
+
+/* PUBLIC FUNCTIONS
+   - run_farm()
+   - read_list_file()
+   - free_list()
+*/
+
+#ifndef POTATOCHIP_FARM
+#define POTATOCHIP_FARM
+
+#include <stdint.h>
+#include <stddef.h>
+#include "headless.h" // struct run_options
+
+/* Read non-empty, non-comment lines of a file into a NULL-terminated array of strings */
+char **read_list_file(const char *path, size_t *count);
+
+/* Free array returned by read_list_file() */
+void free_list(char **list);
+
+/* Run every ROM in rom_list (x every input script in script_list, if given) headless on worker threads */
+int run_farm(const char *rom_list, const char *script_list, int threads, const struct run_options *options);
+
+#endif // POTATOCHIP_FARM
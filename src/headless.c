@@ -0,0 +1,375 @@
+/*
+* PotatoCHIP-8 - Headless
+*
+* Runs a ROM without bringing up SDL or ncurses, for
+* a fixed instruction/frame budget. Used for CI boxes
+* and for measuring raw interpreter throughput.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include "chip8.h" // struct Chip8Memory
+#include "emulator.h" // loadROM()
+#include "jit.h" // jit_create(), jit_execute()
+#include "savestate.h" // load_state(), save_state()
+#include "rewind.h" // rewind_create(), rewind_capture(), rewind_step()
+#include "profile.h" // profile_create(), print_profile()
+#include "trace.h" // trace_open(), trace_close()
+#include "debugger.h" // struct chip8_debug, debug_run()
+#include "headless.h"
+
+#define FNV_OFFSET_BASIS 0xCBF29CE484222325ull
+#define FNV_PRIME 0x100000001B3ull
+
+
+/* FNV-1a hash of a block of bytes, chained from a previous hash (or 0 to start) */
+uint64_t state_hash(uint64_t hash, const void *data, size_t size)
+{
+	const uint8_t *bytes = data;
+	if (hash == 0) { hash = FNV_OFFSET_BASIS; }
+
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+
+/* Combined hash of registers, stack, RAM, and framebuffer */
+uint64_t machine_hash(const struct Chip8Memory *machine)
+{
+	uint64_t hash = state_hash(0, machine->registers, sizeof(machine->registers));
+	hash = state_hash(hash, &machine->index, sizeof(machine->index));
+	hash = state_hash(hash, &machine->pc, sizeof(machine->pc));
+	hash = state_hash(hash, &machine->sp, sizeof(machine->sp));
+	hash = state_hash(hash, machine->stack, sizeof(machine->stack));
+	hash = state_hash(hash, machine->ram, sizeof(machine->ram));
+	return state_hash(hash, machine->screen, sizeof(machine->screen));
+}
+
+
+static int compare_events(const void *a, const void *b)
+{
+	const struct input_event *ea = a;
+	const struct input_event *eb = b;
+	return (ea->frame > eb->frame) - (ea->frame < eb->frame);
+}
+
+
+/* Read input script into script->events
+* - One event per line: "FRAME KEY down|up" (KEY in hex, e.g. "120 5 down")
+* - Blank lines and lines starting with '#' are ignored
+*/
+int load_input_script(const char *path, struct input_script *script)
+{
+	script->events = NULL;
+	script->count = 0;
+
+	FILE *scriptfp = fopen(path, "r");
+	if (scriptfp == NULL)
+	{
+		printf("Error opening input script '%s'\n", path);
+		return -1;
+	}
+
+	size_t capacity = 0;
+	char line[128];
+	int line_number = 0;
+	while (fgets(line, sizeof(line), scriptfp) != NULL)
+	{
+		line_number++;
+		char *start = line + strspn(line, " \t");
+		if (*start == '#' || *start == '\n' || *start == '\0') { continue; }
+
+		unsigned long long frame;
+		unsigned int key;
+		char action[8];
+		if (sscanf(start, "%llu %x %7s", &frame, &key, action) != 3 || key > 0xF ||
+			(strcmp(action, "down") != 0 && strcmp(action, "up") != 0))
+		{
+			printf("Invalid input event on line %d of '%s'\n", line_number, path);
+			fclose(scriptfp);
+			free_input_script(script);
+			return -1;
+		}
+
+		if (script->count == capacity)
+		{
+			capacity = capacity ? capacity * 2 : 64;
+			struct input_event *events = realloc(script->events, capacity * sizeof(struct input_event));
+			if (events == NULL)
+			{
+				puts("Error allocating input script.");
+				fclose(scriptfp);
+				free_input_script(script);
+				return -1;
+			}
+			script->events = events;
+		}
+
+		script->events[script->count].frame = frame;
+		script->events[script->count].key = (uint8_t)key;
+		script->events[script->count].pressed = (action[0] == 'd');
+		script->count++;
+	}
+	fclose(scriptfp);
+
+	qsort(script->events, script->count, sizeof(struct input_event), compare_events);
+	return 0;
+}
+
+
+/* Free events allocated by load_input_script() */
+void free_input_script(struct input_script *script)
+{
+	free(script->events);
+	script->events = NULL;
+	script->count = 0;
+}
+
+
+/* Execute cycles instructions on an initialized machine
+* - Script events (if any) are applied at the start of each frame,
+*   frames counted from the start of this call
+* - Each frame is cycles_per_frame instructions; timers tick once at the
+*   end of every complete frame
+* - While parked on WAIT_KEY, whole frames up to the next script event are
+*   skipped at once (only the timers change), unless every frame is recorded
+* - rewind (may be NULL) captures the state after every complete frame
+* - Runs through the attached JIT, if any (see jit_attach())
+* - cycles counts fast-forwarded instructions (idle loops, WAIT_KEY) like executed ones
+* - Returns number of instructions actually executed, skipped (may be NULL) receives the number fast-forwarded
+*/
+uint64_t run_machine(struct Chip8Memory *machine, const struct input_script *script, uint64_t cycles, uint32_t cycles_per_frame, struct rewind_buffer *rewind, uint64_t *skipped)
+{
+	size_t next_event = 0;
+	uint64_t executed = 0;
+	uint64_t skipped_before = machine->skipped;
+
+	for (uint64_t frame = 0; executed < cycles; frame++)
+	{
+		while (script && next_event < script->count && script->events[next_event].frame <= frame)
+		{
+			set_key(machine, script->events[next_event].key, script->events[next_event].pressed);
+			next_event++;
+		}
+
+		if (machine->key_wait && rewind == NULL)
+		{
+			uint64_t idle = (cycles - executed) / cycles_per_frame;
+			if (script && next_event < script->count && script->events[next_event].frame - frame < idle) { idle = script->events[next_event].frame - frame; }
+			if (idle > 0)
+			{
+				for (uint64_t t = 0; t < idle && (machine->delay_timer || machine->sound_timer); t++) { tick_timers(machine); }
+				if (machine->profile) { machine->profile->frames += idle; machine->profile->idle += idle * cycles_per_frame; }
+				machine->skipped += idle * cycles_per_frame;
+				executed += idle * cycles_per_frame;
+				frame += idle - 1;
+				continue;
+			}
+		}
+
+		uint64_t budget = cycles - executed;
+		if (budget > cycles_per_frame) { budget = cycles_per_frame; }
+
+		uint64_t ran = machine->jit ? jit_execute(machine, budget) : execute_cycles(machine, budget);
+		executed += ran;
+		if (ran < budget) { break; } // JIT lockstep divergence
+		if (budget == cycles_per_frame)
+		{
+			tick_timers(machine);
+			if (machine->profile) { machine->profile->frames++; }
+			if (rewind) { rewind_capture(rewind, machine); }
+		}
+	}
+
+	uint64_t fast_forwarded = machine->skipped - skipped_before;
+	if (skipped) { *skipped = fast_forwarded; }
+	return executed - fast_forwarded;
+}
+
+
+/* Seconds between two CLOCK_MONOTONIC timestamps */
+double elapsed_seconds(const struct timespec *start, const struct timespec *stop)
+{
+	return (double)(stop->tv_sec - start->tv_sec) + (double)(stop->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+
+/* Print registers and RAM/framebuffer hashes of the current machine */
+static void print_final_state(const struct Chip8Memory *machine, uint64_t seed, uint64_t executed, uint64_t skipped, double seconds)
+{
+	printf("PC: 0x%04X  I: 0x%04X  SP: 0x%X  DT: 0x%02X  ST: 0x%02X\n",
+		machine->pc, machine->index, machine->sp, machine->delay_timer, machine->sound_timer);
+	for (int i = 0; i < 16; i++)
+	{
+		printf("V%X: 0x%02X%s", i, machine->registers[i], (i % 8 == 7) ? "\n" : "  ");
+	}
+
+	uint64_t reg_hash = state_hash(0, machine->registers, sizeof(machine->registers));
+	reg_hash = state_hash(reg_hash, &machine->index, sizeof(machine->index));
+	reg_hash = state_hash(reg_hash, &machine->pc, sizeof(machine->pc));
+	reg_hash = state_hash(reg_hash, &machine->sp, sizeof(machine->sp));
+	reg_hash = state_hash(reg_hash, machine->stack, sizeof(machine->stack));
+	uint64_t ram_hash = state_hash(0, machine->ram, sizeof(machine->ram));
+	uint64_t screen_hash = state_hash(0, machine->screen, sizeof(machine->screen));
+
+	printf("Register hash:    %016llx\n", (unsigned long long)reg_hash);
+	printf("RAM hash:         %016llx\n", (unsigned long long)ram_hash);
+	printf("Framebuffer hash: %016llx\n", (unsigned long long)screen_hash);
+	printf("Machine hash:     %016llx\n", (unsigned long long)machine_hash(machine));
+	printf("Seed:             %llu\n", (unsigned long long)seed);
+	printf("Instructions:     %llu\n", (unsigned long long)executed);
+	printf("Fast-forwarded:   %llu\n", (unsigned long long)skipped);
+	printf("Elapsed:          %.6f s\n", seconds);
+	printf("Instructions/sec: %.0f\n", (seconds > 0) ? (double)executed / seconds : 0.0);
+}
+
+
+/* Headless run of an initialized machine through the debugger's breakpoint loop, until PC reaches options->until */
+static int run_until(struct Chip8Memory *machine, const struct run_options *options, uint64_t cycles)
+{
+	if (options->input || options->rewind_frames || options->trace || options->profile || options->core != CORE_INTERP)
+	{
+		puts("--until runs the debugger's interpreter loop, --input/--rewind/--trace/--profile/--core ignored");
+	}
+
+	struct chip8_debug debug = { .finish_sp = DEBUG_FINISH_OFF };
+	debug.breakpoints[options->until >> 6] |= 1ull << (options->until & 63);
+	machine->debug = &debug;
+
+	struct timespec start, stop;
+	uint64_t steps = 0;
+	uint64_t skipped = machine->skipped;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	uint64_t executed = debug_run(machine, cycles, &steps);
+
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	machine->debug = NULL;
+	skipped = machine->skipped - skipped;
+
+	if (debug.stop == DEBUG_STOP_BREAKPOINT) { printf("Stopped:          0x%03X reached\n", options->until); }
+	else { printf("Stopped:          0x%03X not reached\n", options->until); }
+	print_final_state(machine, options->seed, executed - skipped, skipped, elapsed_seconds(&start, &stop));
+
+	if (options->save_state)
+	{
+		if (save_state(machine, options->save_state) != 0) { return -1; }
+		printf("Saved state:      %s\n", options->save_state);
+	}
+	return 0;
+}
+
+
+/* Run ROM without SDL/ncurses for a fixed number of instructions or frames, print final state
+* - If options->frames is given, the budget is frames * cycles_per_frame instructions
+* - options->input is an optional input script path (see load_input_script())
+* - options->load_state/save_state restore the machine before and save it after the run
+* - options->rewind_size keeps per-frame history, options->rewind_frames of it are undone after the run
+* - options->core selects the interpreter or the JIT (optionally in lockstep with the interpreter)
+* - options->profile counts every instruction (interpreter only) and prints a report after the run
+* - options->trace records every instruction to a trace file (built-in interpreter core only, replaces profiling and the JIT)
+* - options->until runs through the debugger's breakpoint loop (see debug_run()) and stops when PC reaches it,
+*   timers tick every CYCLES_PER_FRAME instructions as in the debugger (no input script, rewind, trace, profile, or JIT)
+*/
+int run_headless(const char *rom, const struct run_options *options)
+{
+	uint64_t cycles = options->frames ? options->frames * options->cycles_per_frame : options->cycles;
+	if (cycles == 0)
+	{
+		puts("Headless mode requires --cycles or --frames");
+		return -1;
+	}
+
+	struct Chip8Memory machine;
+	if (initialize_memory(&machine) != 0) { return -1; }
+	seed_rng(&machine, options->seed);
+	if (loadROM(&machine, rom) != 0) { return -1; }
+	if (options->load_state) // Replaces the freshly loaded ROM and RNG state
+	{
+		struct timespec load_start, load_stop;
+		clock_gettime(CLOCK_MONOTONIC, &load_start);
+		if (load_state(&machine, options->load_state) != 0) { return -1; }
+		clock_gettime(CLOCK_MONOTONIC, &load_stop);
+		printf("Loaded state:     %s (%.1f us)\n", options->load_state, elapsed_seconds(&load_start, &load_stop) * 1e6);
+	}
+
+	if (options->until >= 0) { return run_until(&machine, options, cycles); }
+
+	struct input_script script = {0};
+	if (options->input && load_input_script(options->input, &script) != 0) { return -1; }
+
+	struct chip8_trace *trace = NULL;
+	if (options->trace)
+	{
+		trace = trace_open(options->trace);
+		if (trace == NULL) { free_input_script(&script); return -1; }
+		machine.trace = trace;
+		if (options->core != CORE_INTERP || options->profile) { puts("Tracing runs on the built-in interpreter core, --core/--profile ignored"); }
+	}
+
+	struct chip8_profile *profile = NULL;
+	if (options->profile && trace == NULL)
+	{
+		profile = profile_create();
+		if (profile == NULL) { free_input_script(&script); return -1; }
+		machine.profile = profile;
+		if (options->core != CORE_INTERP) { puts("Profiling runs on the interpreter, --core ignored"); }
+	}
+
+	struct chip8_jit *jit = NULL;
+	if (options->core != CORE_INTERP && profile == NULL && trace == NULL)
+	{
+		jit = jit_create(options->core == CORE_JIT_LOCKSTEP);
+		if (jit == NULL) { free_input_script(&script); trace_close(trace); return -1; }
+		jit_attach(jit, &machine);
+	}
+
+	struct rewind_buffer *rewind = NULL;
+	if (options->rewind_size)
+	{
+		rewind = rewind_create(options->rewind_size);
+		if (rewind == NULL) { free_input_script(&script); jit_destroy(jit); trace_close(trace); return -1; }
+		rewind_capture(rewind, &machine); // Frame 0, before anything runs
+	}
+
+	struct timespec start, stop;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	uint64_t skipped;
+	uint64_t executed = run_machine(&machine, &script, cycles, options->cycles_per_frame, rewind, &skipped);
+
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	if (rewind && options->rewind_frames)
+	{
+		printf("Rewound:          %llu frames\n", (unsigned long long)rewind_step(rewind, &machine, options->rewind_frames));
+	}
+	print_final_state(&machine, options->seed, executed, skipped, elapsed_seconds(&start, &stop));
+	free_input_script(&script);
+	if (rewind) { print_rewind_stats(rewind); rewind_destroy(rewind); }
+	if (profile) { print_profile(profile, &machine); profile_destroy(profile); }
+	trace_close(trace);
+
+	int status = 0;
+	if (options->save_state)
+	{
+		if (save_state(&machine, options->save_state) == 0) { printf("Saved state:      %s\n", options->save_state); }
+		else { status = -1; }
+	}
+	if (jit)
+	{
+		if (jit_diverged(jit)) { status = -1; }
+		else if (options->core == CORE_JIT_LOCKSTEP) { puts("Lockstep:         JIT matched interpreter after every block"); }
+		jit_destroy(jit);
+	}
+	return status;
+}
@@ -0,0 +1,85 @@
+/*
+* PotatoCHIP-8 - Headless Header
+*
+* Display-less execution for batch runs/benchmarking
+*/
+
+/* PUBLIC FUNCTIONS
+   - run_headless()
+   - run_machine()
+   - load_input_script()
+   - free_input_script()
+   - state_hash()
+   - machine_hash()
+   - elapsed_seconds()
+
+   PUBLIC STRUCTS
+   - input_event
+   - input_script
+   - run_options
+*/
+
+#ifndef POTATOCHIP_HEADLESS
+#define POTATOCHIP_HEADLESS
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include "chip8.h" // struct Chip8Memory
+#include "jit.h" // enum core_mode
+#include "rewind.h" // struct rewind_buffer
+
+/* Single scripted key press/release, applied at the start of the given frame */
+struct input_event{
+	uint64_t frame;
+	uint8_t key;     // Keypad key (0x0 - 0xF)
+	uint8_t pressed; // 1 = down, 0 = up
+};
+
+/* Input script, events sorted by frame */
+struct input_script{
+	struct input_event *events;
+	size_t count;
+};
+
+/* Budget/core options shared by headless and farm runs */
+struct run_options{
+	const char *input;         // Input script path (headless only, may be NULL)
+	uint64_t cycles;           // Instruction budget
+	uint64_t frames;           // Frame budget, overrides cycles if non-zero
+	uint32_t cycles_per_frame; // Instructions per 60Hz frame (--ips / 60)
+	uint64_t seed;             // RAND seed for every machine (see seed_rng())
+	const char *load_state;    // State file restored before running (headless only, may be NULL)
+	const char *save_state;    // State file written after running (headless only, may be NULL)
+	size_t rewind_size;        // Rewind history bytes (0 = no history)
+	uint64_t rewind_frames;    // Headless: frames to rewind after running
+	int profile;               // Count instructions per handler/address and print a report (headless/SDL)
+	const char *trace;         // Trace file recording every instruction (headless/SDL, may be NULL)
+	int32_t until;             // Headless: stop when PC reaches this address, through the debugger's loop (-1 = off)
+	enum core_mode core;
+};
+
+/* FNV-1a hash of a block of bytes, chained from a previous hash (or 0 to start) */
+uint64_t state_hash(uint64_t hash, const void *data, size_t size);
+
+/* Combined hash of registers, stack, RAM, and framebuffer */
+uint64_t machine_hash(const struct Chip8Memory *machine);
+
+/* Seconds between two CLOCK_MONOTONIC timestamps */
+double elapsed_seconds(const struct timespec *start, const struct timespec *stop);
+
+/* Read "FRAME KEY down|up" lines from file into script */
+int load_input_script(const char *path, struct input_script *script);
+
+/* Free events allocated by load_input_script() */
+void free_input_script(struct input_script *script);
+
+/* Execute cycles instructions on an initialized machine (through its JIT, if attached), applying script (may be NULL), ticking timers, and capturing rewind history (may be NULL) at frame boundaries
+* - Returns instructions actually run, skipped (may be NULL) receives those fast-forwarded instead
+*/
+uint64_t run_machine(struct Chip8Memory *machine, const struct input_script *script, uint64_t cycles, uint32_t cycles_per_frame, struct rewind_buffer *rewind, uint64_t *skipped);
+
+/* Run ROM without SDL/ncurses for a fixed number of instructions or frames, print final state */
+int run_headless(const char *rom, const struct run_options *options);
+
+#endif // POTATOCHIP_HEADLESS
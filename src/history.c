@@ -0,0 +1,347 @@
+/*
+* PotatoCHIP-8 - Execution History
+*
+* Undo records of executed instructions in a ring of fixed-size chunks.
+* Before an instruction runs, only the state it is about to change
+* is saved: one register, I, the SP and a stack slot, the timers,
+* up to 16 RAM bytes or registers, or the non-blank screen rows for
+* CLS. Records are [PC][old state][tag], where the tag's low nibble
+* is the record kind and the high nibble its argument, so the record
+* size follows from the tag alone and undo can pop records from the
+* newest end. Most instructions take 3-5 bytes.
+*
+* Records never straddle a chunk, so when the ring is full the oldest
+* whole chunk is dropped at once instead of parsing records one by one.
+*
+* DRAW only saves VF: XORing the same sprite again restores the
+* screen, and undoing newest-first guarantees I, Vx, Vy and the
+* sprite bytes are what they were when it was drawn.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "chip8.h" // struct Chip8Memory, decode_op(), execute_op(), invalidate_decoded()
+#include "history.h"
+
+
+#define HISTORY_CHUNK 65536 // Bytes per chunk, the unit old history is dropped in
+#define SCREEN_GROUP_ROWS 8 // CLS saves rows in groups of 8, one tag argument bit per non-blank group
+
+enum record_kind{
+	RECORD_PC = 0,   // Only PC changes (jumps, skips, NOOP)
+	RECORD_V,        // Vx (argument x)
+	RECORD_VF,       // Vx and VF (argument x)
+	RECORD_INDEX,    // I
+	RECORD_STACK,    // SP and the stack slot it pointed at
+	RECORD_TIMERS,   // Delay and sound timer (Fx15, Fx18)
+	RECORD_RAND,     // Vx and the RNG state (argument x)
+	RECORD_WAIT_KEY, // Vx and key_wait (argument x)
+	RECORD_DRAW,     // VF, the screen is restored by drawing again
+	RECORD_CLS,      // Non-blank 8-row groups of the screen (argument = group mask)
+	RECORD_RAM,      // Address and RAM bytes (argument = count - 1)
+	RECORD_REGS,     // V0 - Vn (argument = n)
+	RECORD_TICK,     // Timers before a tick_timers(), no PC
+};
+
+struct history_chunk{
+	uint32_t used;  // Bytes of records
+	uint32_t count; // Instruction records (RECORD_TICK not counted)
+};
+
+struct chip8_history{
+	uint8_t *data;                 // chunk_count * HISTORY_CHUNK bytes
+	struct history_chunk *chunks;
+	size_t chunk_count;
+	size_t first;                  // Oldest chunk
+	size_t current;                // Chunk records are appended to/popped from
+	uint64_t count;                // Instruction records held
+	size_t bytes;                  // Bytes of records held
+	uint16_t sizes[256];           // record_size() of every tag
+	uint8_t tags[0x10000];         // Tag of every opcode (CLS's argument is filled in when recording)
+};
+
+
+/* Record size, including the tag */
+static size_t record_size(uint8_t tag)
+{
+	uint8_t argument = tag >> 4;
+
+	switch (tag & 0xF) {
+		case RECORD_V: return 4;
+		case RECORD_VF: return 5;
+		case RECORD_INDEX: return 5;
+		case RECORD_STACK: return 6;
+		case RECORD_TIMERS: return 5;
+		case RECORD_RAND: return 4 + sizeof(uint64_t);
+		case RECORD_WAIT_KEY: return 5;
+		case RECORD_DRAW: return 4;
+		case RECORD_CLS: return 3 + __builtin_popcount(argument) * SCREEN_GROUP_ROWS * sizeof(uint64_t);
+		case RECORD_RAM: return 5 + argument + 1;
+		case RECORD_REGS: return 3 + argument + 1;
+		case RECORD_TICK: return 3;
+		default: return 3; // RECORD_PC
+	}
+}
+
+/* Tag for what opcode changes, matching the nested decode tables */
+static uint8_t opcode_tag(uint16_t opcode)
+{
+	uint8_t x = (opcode >> 8) & 0xF;
+
+	switch (opcode >> 12) {
+		case 0x0:
+			if (opcode == 0x00E0) { return RECORD_CLS; }
+			if (opcode == 0x00EE) { return RECORD_STACK; }
+			return RECORD_PC;
+		case 0x2: return RECORD_STACK;
+		case 0x6: case 0x7: return RECORD_V | x << 4;
+		case 0x8: return RECORD_VF | x << 4;
+		case 0xA: return RECORD_INDEX;
+		case 0xC: return RECORD_RAND | x << 4;
+		case 0xD: return RECORD_DRAW;
+		case 0xF:
+			switch (opcode & 0xFF) {
+				case 0x07: return RECORD_V | x << 4;
+				case 0x0A: return RECORD_WAIT_KEY | x << 4;
+				case 0x15: case 0x18: return RECORD_TIMERS;
+				case 0x1E: case 0x29: return RECORD_INDEX;
+				case 0x33: return RECORD_RAM | 2 << 4;
+				case 0x55: return RECORD_RAM | x << 4;
+				case 0x65: return RECORD_REGS | x << 4;
+			}
+			return RECORD_PC;
+		default: return RECORD_PC; // Jumps and skips
+	}
+}
+
+
+/* Allocate ring of size bytes (rounded down to whole chunks, at least 2) */
+struct chip8_history *history_create(size_t size)
+{
+	if (size < 2 * HISTORY_CHUNK)
+	{
+		printf("History buffer must be at least %d bytes\n", 2 * HISTORY_CHUNK);
+		return NULL;
+	}
+
+	struct chip8_history *history = calloc(1, sizeof(struct chip8_history));
+	if (history == NULL) { return NULL; }
+	history->chunk_count = size / HISTORY_CHUNK;
+	history->data = malloc(history->chunk_count * HISTORY_CHUNK);
+	history->chunks = calloc(history->chunk_count, sizeof(struct history_chunk));
+	if (history->data == NULL || history->chunks == NULL)
+	{
+		puts("Error allocating history buffer.");
+		history_destroy(history);
+		return NULL;
+	}
+	for (int tag = 0; tag < 256; tag++) { history->sizes[tag] = record_size(tag); }
+	for (uint32_t opcode = 0; opcode <= 0xFFFF; opcode++) { history->tags[opcode] = opcode_tag(opcode); }
+	return history;
+}
+
+
+/* Free ring */
+void history_destroy(struct chip8_history *history)
+{
+	if (history == NULL) { return; }
+	free(history->data);
+	free(history->chunks);
+	free(history);
+}
+
+
+/* Room for a record of tag, returns where to write it
+* - Moves on to the next chunk if it doesn't fit, dropping the oldest chunk when that one is still held
+*/
+static uint8_t *reserve(struct chip8_history *history, uint8_t tag)
+{
+	if (history->chunks[history->current].used + history->sizes[tag] > HISTORY_CHUNK)
+	{
+		history->current = (history->current + 1) % history->chunk_count;
+		if (history->current == history->first)
+		{
+			struct history_chunk *oldest = &history->chunks[history->first];
+			history->count -= oldest->count;
+			history->bytes -= oldest->used;
+			history->first = (history->first + 1) % history->chunk_count;
+		}
+		history->chunks[history->current] = (struct history_chunk){ 0, 0 };
+	}
+	return history->data + history->current * HISTORY_CHUNK + history->chunks[history->current].used;
+}
+
+/* Close the record written at reserve() with its tag */
+static void commit(struct chip8_history *history, uint8_t *record, uint8_t tag)
+{
+	struct history_chunk *chunk = &history->chunks[history->current];
+	size_t size = history->sizes[tag];
+	record[size - 1] = tag;
+	chunk->used += size;
+	history->bytes += size;
+	if ((tag & 0xF) != RECORD_TICK)
+	{
+		chunk->count++;
+		history->count++;
+	}
+}
+
+
+/* Record what op is about to change (see enum record_kind), this runs before every instruction in the debugger */
+void history_record(struct chip8_history *history, const struct Chip8Memory *machine, const struct chip8_op *op)
+{
+	uint16_t pc = machine->pc - 2;
+	uint8_t tag = history->tags[op->opcode];
+	uint8_t argument = tag >> 4;
+
+	if (tag == RECORD_CLS)
+	{
+		for (unsigned int group = 0; group < SCREEN_HEIGHT / SCREEN_GROUP_ROWS; group++)
+		{
+			uint64_t lit = 0;
+			for (int row = 0; row < SCREEN_GROUP_ROWS; row++) { lit |= machine->screen[group * SCREEN_GROUP_ROWS + row]; }
+			if (lit) { argument |= 1 << group; }
+		}
+		tag |= argument << 4;
+	}
+
+	uint8_t *record = reserve(history, tag);
+	uint8_t *body = record + 2;
+	record[0] = pc & 0xFF;
+	record[1] = pc >> 8;
+
+	switch (tag & 0xF) {
+		case RECORD_V: body[0] = machine->registers[argument]; break;
+		case RECORD_VF: body[0] = machine->registers[argument]; body[1] = machine->registers[0xF]; break;
+		case RECORD_INDEX: body[0] = machine->index & 0xFF; body[1] = machine->index >> 8; break;
+		case RECORD_STACK:
+			body[0] = machine->sp;
+			body[1] = machine->stack[machine->sp & (STACK_SIZE - 1)] & 0xFF;
+			body[2] = machine->stack[machine->sp & (STACK_SIZE - 1)] >> 8;
+			break;
+		case RECORD_TIMERS: body[0] = machine->delay_timer; body[1] = machine->sound_timer; break;
+		case RECORD_RAND: body[0] = machine->registers[argument]; memcpy(body + 1, &machine->rng, sizeof(uint64_t)); break;
+		case RECORD_WAIT_KEY: body[0] = machine->registers[argument]; body[1] = machine->key_wait; break;
+		case RECORD_DRAW: body[0] = machine->registers[0xF]; break;
+		case RECORD_CLS:
+			for (unsigned int group = 0; group < SCREEN_HEIGHT / SCREEN_GROUP_ROWS; group++)
+			{
+				if (!(argument & (1 << group))) { continue; }
+				memcpy(body, &machine->screen[group * SCREEN_GROUP_ROWS], SCREEN_GROUP_ROWS * sizeof(uint64_t));
+				body += SCREEN_GROUP_ROWS * sizeof(uint64_t);
+			}
+			break;
+		case RECORD_RAM:
+			body[0] = machine->index & 0xFF;
+			body[1] = machine->index >> 8;
+			for (int i = 0; i <= argument; i++) { body[2 + i] = machine->ram[(machine->index + i) & (TOTAL_RAM - 1)]; }
+			break;
+		case RECORD_REGS: memcpy(body, machine->registers, argument + 1); break;
+	}
+	commit(history, record, tag);
+}
+
+
+/* Record timers before tick_timers() */
+void history_record_tick(struct chip8_history *history, const struct Chip8Memory *machine)
+{
+	uint8_t *record = reserve(history, RECORD_TICK);
+	record[0] = machine->delay_timer;
+	record[1] = machine->sound_timer;
+	commit(history, record, RECORD_TICK);
+}
+
+
+/* Pop and undo records until one instruction has been undone
+* - Timer ticks recorded after that instruction are undone on the way
+* - Returns 0 (machine unchanged apart from ticks) once history is empty
+*/
+int history_undo(struct chip8_history *history, struct Chip8Memory *machine)
+{
+	while (1)
+	{
+		struct history_chunk *chunk = &history->chunks[history->current];
+		if (chunk->used == 0)
+		{
+			if (history->current == history->first) { return 0; }
+			history->current = (history->current + history->chunk_count - 1) % history->chunk_count;
+			continue;
+		}
+
+		const uint8_t *base = history->data + history->current * HISTORY_CHUNK;
+		uint8_t tag = base[chunk->used - 1];
+		chunk->used -= history->sizes[tag];
+		history->bytes -= history->sizes[tag];
+		const uint8_t *record = base + chunk->used;
+
+		if (tag == RECORD_TICK)
+		{
+			machine->delay_timer = record[0];
+			machine->sound_timer = record[1];
+			continue;
+		}
+
+		uint8_t argument = tag >> 4;
+		uint16_t pc = record[0] | record[1] << 8;
+		const uint8_t *body = record + 2;
+		switch (tag & 0xF) {
+			case RECORD_V: machine->registers[argument] = body[0]; break;
+			case RECORD_VF: machine->registers[0xF] = body[1]; machine->registers[argument] = body[0]; break;
+			case RECORD_INDEX: machine->index = body[0] | body[1] << 8; break;
+			case RECORD_STACK:
+				machine->stack[body[0] & (STACK_SIZE - 1)] = body[1] | body[2] << 8;
+				machine->sp = body[0];
+				break;
+			case RECORD_TIMERS: machine->delay_timer = body[0]; machine->sound_timer = body[1]; break;
+			case RECORD_RAND: machine->registers[argument] = body[0]; memcpy(&machine->rng, body + 1, sizeof(uint64_t)); break;
+			case RECORD_WAIT_KEY: machine->registers[argument] = body[0]; machine->key_wait = body[1]; break;
+			case RECORD_DRAW:
+			{
+				struct chip8_op op;
+				decode_op(&op, (uint16_t)(machine->ram[pc & (TOTAL_RAM - 1)] << 8u | machine->ram[(pc + 1) & (TOTAL_RAM - 1)]));
+				machine->registers[0xF] = body[0]; // Vx/Vy may be VF, draw from the same position as before
+				execute_op(machine, &op);
+				machine->registers[0xF] = body[0];
+				break;
+			}
+			case RECORD_CLS:
+				for (unsigned int group = 0; group < SCREEN_HEIGHT / SCREEN_GROUP_ROWS; group++)
+				{
+					if (!(argument & (1 << group))) { continue; }
+					memcpy(&machine->screen[group * SCREEN_GROUP_ROWS], body, SCREEN_GROUP_ROWS * sizeof(uint64_t));
+					body += SCREEN_GROUP_ROWS * sizeof(uint64_t);
+				}
+				machine->dirty_rows = 0xFFFFFFFF;
+				break;
+			case RECORD_RAM:
+			{
+				uint16_t address = body[0] | body[1] << 8;
+				for (int i = 0; i <= argument; i++) { machine->ram[(address + i) & (TOTAL_RAM - 1)] = body[2 + i]; }
+				invalidate_decoded(machine, address & (TOTAL_RAM - 1), argument + 1);
+				break;
+			}
+			case RECORD_REGS: memcpy(machine->registers, body, argument + 1); break;
+		}
+		machine->pc = pc;
+		chunk->count--;
+		history->count--;
+		return 1;
+	}
+}
+
+
+/* Instructions held */
+uint64_t history_count(const struct chip8_history *history)
+{
+	return history->count;
+}
+
+/* Bytes held */
+size_t history_bytes(const struct chip8_history *history)
+{
+	return history->bytes;
+}
@@ -0,0 +1,50 @@
+/*
+* PotatoCHIP-8 - Execution History Header
+*
+* Per-instruction undo records for reverse stepping in the debugger
+*/
+
+/* PUBLIC FUNCTIONS
+   - history_create()
+   - history_destroy()
+   - history_record()
+   - history_record_tick()
+   - history_undo()
+   - history_count()
+   - history_bytes()
+
+   PUBLIC STRUCTS
+   - chip8_history (opaque)
+*/
+
+#ifndef POTATOCHIP_HISTORY
+#define POTATOCHIP_HISTORY
+
+#include <stdint.h>
+#include <stddef.h>
+#include "chip8.h" // struct Chip8Memory, struct chip8_op
+
+struct chip8_history;
+
+/* Allocate history ring of (at most) size bytes, at least 128 KB. Returns NULL on failure */
+struct chip8_history *history_create(size_t size);
+
+/* Free history ring */
+void history_destroy(struct chip8_history *history);
+
+/* Record what op is about to change, called after fetch (PC already past op) and before executing it */
+void history_record(struct chip8_history *history, const struct Chip8Memory *machine, const struct chip8_op *op);
+
+/* Record timers before a tick_timers() between instructions */
+void history_record_tick(struct chip8_history *history, const struct Chip8Memory *machine);
+
+/* Undo the newest instruction (and any timer ticks after it). Returns 1 if an instruction was undone, 0 if history is empty */
+int history_undo(struct chip8_history *history, struct Chip8Memory *machine);
+
+/* Instructions that can currently be undone */
+uint64_t history_count(const struct chip8_history *history);
+
+/* Bytes of undo records currently held */
+size_t history_bytes(const struct chip8_history *history);
+
+#endif // POTATOCHIP_HISTORY
@@ -0,0 +1,503 @@
+/*
+* PotatoCHIP-8 - JIT
+*
+* Basic-block dynamic recompiler for x86-64 hosts.
+*
+* A block starts at PC and runs until the first instruction
+* that changes control flow (JP, CALL, RET, skips, Bnnn, Fx0A)
+* or writes RAM (Fx33, Fx55), or MAX_BLOCK_INSTRUCTIONS. Simple
+* register/immediate instructions are emitted natively; everything
+* else calls back into the interpreter handler through execute_op().
+*
+* Generated code runs with:
+*   rbx = struct Chip8Memory * (all machine state addressed off rbx)
+*   r12 = remaining instruction budget
+* Blocks end by storing PC and jumping straight into the next
+* block's code through the entry table, so hot loops never return
+* to C. A block whose length exceeds the budget left (or that isn't
+* translated yet) exits back to jit_execute().
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "chip8.h" // struct Chip8Memory, decode_op(), execute_op(), execute_cycles()
+#include "jit.h"
+
+#if defined(__x86_64__)
+
+#include <sys/mman.h>
+
+#define JIT_ARENA_SIZE (1024 * 1024)
+#define MAX_BLOCK_INSTRUCTIONS 64
+#define MAX_BLOCK_BYTES 8192 // Worst case code size of one block, checked before compiling
+
+/* How the JIT treats each interpreter handler */
+enum jit_class{
+	J_HELPER = 0, // Call interpreter handler, block continues
+	J_LD_BYTE, J_ADD, J_LD_R, J_OR, J_AND, J_XOR, J_ADD_R,
+	J_SET_INDEX, J_I_ADD, J_LD_DT, J_SET_DT, J_SET_ST,
+	J_JMP, J_SKIP_EQ, J_SKIP_N_EQ, J_SKIP_EQ_R, J_SKIP_N_EQ_R,
+	J_TERMINATOR, // Call interpreter handler, block ends (CALL, RET, Bnnn, key skips, Fx0A, Fx33, Fx55)
+};
+
+/* Entry trampoline: rdi = machine, rsi = code, rdx = budget. Returns remaining budget */
+typedef int64_t (*jit_enter_fn)(struct Chip8Memory *machine, void *code, int64_t budget);
+
+struct chip8_jit{
+	uint8_t *arena;
+	size_t used;
+	size_t code_start;                   // First byte after the trampolines
+	jit_enter_fn enter;
+	uint8_t *exit_stub;
+	void *entry[TOTAL_RAM];              // Translated block starting at address, or NULL
+	uint16_t block_end[TOTAL_RAM];       // First address after the block starting at address
+	uint8_t length[TOTAL_RAM];           // Instructions in the block starting at address
+	struct chip8_op ops[TOTAL_RAM];      // Operands for helper calls, by instruction address
+	uint8_t handler_class[256];          // enum jit_class by interpreter handler index
+	struct Chip8Memory *machine;
+	struct Chip8Memory *shadow;          // Lockstep: interpreter copy run alongside each block
+	int lockstep;
+	int diverged;
+};
+
+struct emitter{
+	uint8_t *code;
+	size_t pos;
+};
+
+#define OFF(field) ((int32_t)offsetof(struct Chip8Memory, field))
+#define V(x) (OFF(registers) + (int32_t)(x))
+
+
+/*** Emitter ***/
+
+static void emit8(struct emitter *e, uint8_t value) { e->code[e->pos++] = value; }
+static void emit16(struct emitter *e, uint16_t value) { memcpy(e->code + e->pos, &value, 2); e->pos += 2; }
+static void emit32(struct emitter *e, uint32_t value) { memcpy(e->code + e->pos, &value, 4); e->pos += 4; }
+static void emit64(struct emitter *e, uint64_t value) { memcpy(e->code + e->pos, &value, 8); e->pos += 8; }
+
+/* ModRM for [rbx + disp32] with reg field */
+static void emit_rbx_disp(struct emitter *e, uint8_t reg, int32_t disp)
+{
+	emit8(e, 0x80 | (uint8_t)(reg << 3) | 0x3);
+	emit32(e, (uint32_t)disp);
+}
+
+/* rel32 branch to target (opcode bytes already emitted) */
+static void emit_rel32(struct emitter *e, const uint8_t *target)
+{
+	int64_t rel = target - (e->code + e->pos + 4);
+	emit32(e, (uint32_t)(int32_t)rel);
+}
+
+static void emit_jcc(struct emitter *e, uint8_t cc, const uint8_t *target) { emit8(e, 0x0F); emit8(e, cc); emit_rel32(e, target); }
+static void emit_jmp(struct emitter *e, const uint8_t *target) { emit8(e, 0xE9); emit_rel32(e, target); }
+
+#define CC_JAE 0x83
+#define CC_JE  0x84
+#define CC_JNE 0x85
+#define CC_JL  0x8C
+
+static void emit_mov_byte_imm(struct emitter *e, int32_t disp, uint8_t imm) { emit8(e, 0xC6); emit_rbx_disp(e, 0, disp); emit8(e, imm); }
+static void emit_add_byte_imm(struct emitter *e, int32_t disp, uint8_t imm) { emit8(e, 0x80); emit_rbx_disp(e, 0, disp); emit8(e, imm); }
+static void emit_cmp_byte_imm(struct emitter *e, int32_t disp, uint8_t imm) { emit8(e, 0x80); emit_rbx_disp(e, 7, disp); emit8(e, imm); }
+static void emit_load_al(struct emitter *e, int32_t disp) { emit8(e, 0x8A); emit_rbx_disp(e, 0, disp); }
+static void emit_store_al(struct emitter *e, int32_t disp) { emit8(e, 0x88); emit_rbx_disp(e, 0, disp); }
+static void emit_mov_word_imm(struct emitter *e, int32_t disp, uint16_t imm) { emit8(e, 0x66); emit8(e, 0xC7); emit_rbx_disp(e, 0, disp); emit16(e, imm); }
+
+/* Call execute_op(machine, op) */
+static void emit_helper_call(struct emitter *e, const struct chip8_op *op)
+{
+	emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xDF);                  // mov rdi, rbx
+	emit8(e, 0x48); emit8(e, 0xBE); emit64(e, (uint64_t)(uintptr_t)op); // mov rsi, op
+	emit8(e, 0x48); emit8(e, 0xB8); emit64(e, (uint64_t)(uintptr_t)execute_op); // mov rax, execute_op
+	emit8(e, 0xFF); emit8(e, 0xD0);                                  // call rax
+}
+
+/* Jump to the block at machine->pc if translated, otherwise exit to jit_execute() */
+static void emit_chain(struct chip8_jit *jit, struct emitter *e)
+{
+	emit8(e, 0x0F); emit8(e, 0xB7); emit_rbx_disp(e, 0, OFF(pc));      // movzx eax, word [pc]
+	emit8(e, 0x3D); emit32(e, TOTAL_RAM);                              // cmp eax, TOTAL_RAM
+	emit_jcc(e, CC_JAE, jit->exit_stub);
+	emit8(e, 0x48); emit8(e, 0xB9); emit64(e, (uint64_t)(uintptr_t)jit->entry); // mov rcx, entry
+	emit8(e, 0x48); emit8(e, 0x8B); emit8(e, 0x04); emit8(e, 0xC1);   // mov rax, [rcx + rax*8]
+	emit8(e, 0x48); emit8(e, 0x85); emit8(e, 0xC0);                   // test rax, rax
+	emit_jcc(e, CC_JE, jit->exit_stub);
+	emit8(e, 0xFF); emit8(e, 0xE0);                                   // jmp rax
+}
+
+
+/*** Translation ***/
+
+/* Classify interpreter handlers by decoding a representative opcode of each */
+static void build_handler_classes(struct chip8_jit *jit)
+{
+	static const struct { uint16_t opcode; uint8_t jit_class; } representatives[] = {
+		{ 0x6000, J_LD_BYTE }, { 0x7000, J_ADD }, { 0x8000, J_LD_R }, { 0x8001, J_OR }, { 0x8002, J_AND },
+		{ 0x8003, J_XOR }, { 0x8004, J_ADD_R }, { 0xA000, J_SET_INDEX }, { 0xF01E, J_I_ADD }, { 0xF007, J_LD_DT },
+		{ 0xF015, J_SET_DT }, { 0xF018, J_SET_ST }, { 0x1000, J_JMP }, { 0x3000, J_SKIP_EQ }, { 0x4000, J_SKIP_N_EQ },
+		{ 0x5000, J_SKIP_EQ_R }, { 0x9000, J_SKIP_N_EQ_R }, { 0x2000, J_TERMINATOR }, { 0x00EE, J_TERMINATOR },
+		{ 0xB000, J_TERMINATOR }, { 0xE09E, J_TERMINATOR }, { 0xE0A1, J_TERMINATOR }, { 0xF00A, J_TERMINATOR },
+		{ 0xF033, J_TERMINATOR }, { 0xF055, J_TERMINATOR },
+	};
+
+	memset(jit->handler_class, J_HELPER, sizeof(jit->handler_class));
+	for (size_t i = 0; i < sizeof(representatives) / sizeof(representatives[0]); i++)
+	{
+		struct chip8_op op;
+		decode_op(&op, representatives[i].opcode);
+		jit->handler_class[op.handler] = representatives[i].jit_class;
+	}
+}
+
+static int ends_block(uint8_t jit_class)
+{
+	return jit_class >= J_JMP;
+}
+
+/* Emit one instruction at address. Returns 1 if it ends the block */
+static int emit_instruction(struct chip8_jit *jit, struct emitter *e, uint16_t address, int last)
+{
+	const struct chip8_op *op = &jit->ops[address];
+	uint8_t jit_class = jit->handler_class[op->handler];
+	uint16_t next = address + 2;
+
+	if (last || ends_block(jit_class)) { emit_mov_word_imm(e, OFF(ir), op->opcode); }
+
+	switch (jit_class)
+	{
+		case J_LD_BYTE: emit_mov_byte_imm(e, V(op->x), op->kk); break;
+		case J_ADD: emit_add_byte_imm(e, V(op->x), op->kk); break;
+		case J_LD_R: emit_load_al(e, V(op->y)); emit_store_al(e, V(op->x)); break;
+		case J_OR: emit_load_al(e, V(op->y)); emit8(e, 0x08); emit_rbx_disp(e, 0, V(op->x)); break;
+		case J_AND: emit_load_al(e, V(op->y)); emit8(e, 0x20); emit_rbx_disp(e, 0, V(op->x)); break;
+		case J_XOR: emit_load_al(e, V(op->y)); emit8(e, 0x30); emit_rbx_disp(e, 0, V(op->x)); break;
+		case J_ADD_R:
+			emit8(e, 0x0F); emit8(e, 0xB6); emit_rbx_disp(e, 0, V(op->x)); // movzx eax, byte [Vx]
+			emit8(e, 0x0F); emit8(e, 0xB6); emit_rbx_disp(e, 1, V(op->y)); // movzx ecx, byte [Vy]
+			emit8(e, 0x01); emit8(e, 0xC8);                                // add eax, ecx
+			emit_store_al(e, V(op->x));
+			emit8(e, 0xC1); emit8(e, 0xE8); emit8(e, 8);                   // shr eax, 8 (carry)
+			emit_store_al(e, V(0xF));
+			break;
+		case J_SET_INDEX: emit_mov_word_imm(e, OFF(index), op->nnn); break;
+		case J_I_ADD:
+			emit8(e, 0x0F); emit8(e, 0xB6); emit_rbx_disp(e, 0, V(op->x)); // movzx eax, byte [Vx]
+			emit8(e, 0x66); emit8(e, 0x01); emit_rbx_disp(e, 0, OFF(index)); // add word [I], ax
+			break;
+		case J_LD_DT: emit_load_al(e, OFF(delay_timer)); emit_store_al(e, V(op->x)); break;
+		case J_SET_DT: emit_load_al(e, V(op->x)); emit_store_al(e, OFF(delay_timer)); break;
+		case J_SET_ST: emit_load_al(e, V(op->x)); emit_store_al(e, OFF(sound_timer)); break;
+
+		case J_JMP:
+			emit_mov_word_imm(e, OFF(pc), op->nnn);
+			return 1;
+
+		case J_SKIP_EQ:
+		case J_SKIP_N_EQ:
+		case J_SKIP_EQ_R:
+		case J_SKIP_N_EQ_R:
+			emit_mov_word_imm(e, OFF(pc), next);
+			if (jit_class == J_SKIP_EQ || jit_class == J_SKIP_N_EQ) { emit_cmp_byte_imm(e, V(op->x), op->kk); }
+			else { emit_load_al(e, V(op->x)); emit8(e, 0x3A); emit_rbx_disp(e, 0, V(op->y)); } // cmp al, [Vy]
+			emit8(e, (jit_class == J_SKIP_EQ || jit_class == J_SKIP_EQ_R) ? 0x75 : 0x74);  // jne/je over the add
+			emit8(e, 8);
+			emit8(e, 0x66); emit8(e, 0x83); emit_rbx_disp(e, 0, OFF(pc)); emit8(e, 2); // add word [pc], 2
+			return 1;
+
+		case J_TERMINATOR:
+			emit_mov_word_imm(e, OFF(pc), next);
+			emit_helper_call(e, op);
+			return 1;
+
+		default:
+			emit_helper_call(e, op);
+			break;
+	}
+	return 0;
+}
+
+
+/* Drop every block and reuse the whole arena */
+static void flush_blocks(struct chip8_jit *jit)
+{
+	memset(jit->entry, 0, sizeof(jit->entry));
+	jit->used = jit->code_start;
+}
+
+/* Non-zero if the instruction at address is WAIT_KEY, a JP to itself, or the JP of a "LD Vx, DT; SE Vx, 0x00; JP" idle loop (see idle_cycles()) */
+static int closes_idle_loop(const struct chip8_jit *jit, const struct Chip8Memory *machine, uint16_t address)
+{
+	const struct chip8_op *op = &jit->ops[address];
+	if ((op->opcode & 0xF0FF) == 0xF00A) { return 1; }
+	if (jit->handler_class[op->handler] != J_JMP) { return 0; }
+	if (op->nnn == address) { return 1; }
+	if (op->nnn + 4 != address) { return 0; }
+
+	const uint8_t *ram = machine->ram;
+	return (ram[op->nnn] & 0xF0) == 0xF0 && ram[op->nnn + 1] == 0x07 &&
+		ram[op->nnn + 2] == (0x30 | (ram[op->nnn] & 0x0F)) && ram[op->nnn + 3] == 0x00;
+}
+
+/* Translate block starting at start, returns its code or NULL if it can't be translated */
+static void *compile_block(struct chip8_jit *jit, struct Chip8Memory *machine, uint16_t start)
+{
+	if (start >= TOTAL_RAM - 1) { return NULL; }
+	if (JIT_ARENA_SIZE - jit->used < MAX_BLOCK_BYTES) { flush_blocks(jit); }
+
+	/* Find block extent */
+	uint16_t address = start;
+	uint8_t count = 0;
+	while (1)
+	{
+		decode_op(&jit->ops[address], (uint16_t)(machine->ram[address] << 8u | machine->ram[address + 1]));
+		count++;
+		if (ends_block(jit->handler_class[jit->ops[address].handler])) { address += 2; break; }
+		address += 2;
+		if (count == MAX_BLOCK_INSTRUCTIONS || address >= TOTAL_RAM - 1) { break; }
+	}
+
+	struct emitter e = { jit->arena + jit->used, 0 };
+
+	/* Prologue: exit (PC already == start) unless the whole block fits the budget */
+	emit8(&e, 0x49); emit8(&e, 0x81); emit8(&e, 0xFC); emit32(&e, count); // cmp r12, count
+	emit_jcc(&e, CC_JL, jit->exit_stub);
+	emit8(&e, 0x49); emit8(&e, 0x81); emit8(&e, 0xEC); emit32(&e, count); // sub r12, count
+
+	int terminated = 0;
+	for (uint16_t at = start; at < address; at += 2)
+	{
+		terminated = emit_instruction(jit, &e, at, at + 2 == address);
+	}
+	if (!terminated) { emit_mov_word_imm(&e, OFF(pc), address); }
+	if (closes_idle_loop(jit, machine, address - 2)) { emit_jmp(&e, jit->exit_stub); } // Let jit_execute() fast-forward
+	else { emit_chain(jit, &e); }
+
+	void *code = jit->arena + jit->used;
+	jit->used += (e.pos + 15) & ~(size_t)15;
+	jit->entry[start] = code;
+	jit->block_end[start] = address;
+	jit->length[start] = count;
+	return code;
+}
+
+
+/* Emit entry trampoline and shared exit stub at the start of the arena */
+static void emit_trampolines(struct chip8_jit *jit)
+{
+	struct emitter e = { jit->arena, 0 };
+
+	/* Exit: return remaining budget */
+	jit->exit_stub = e.code + e.pos;
+	emit8(&e, 0x4C); emit8(&e, 0x89); emit8(&e, 0xE0); // mov rax, r12
+	emit8(&e, 0x41); emit8(&e, 0x5D);                  // pop r13
+	emit8(&e, 0x41); emit8(&e, 0x5C);                  // pop r12
+	emit8(&e, 0x5B);                                   // pop rbx
+	emit8(&e, 0xC3);                                   // ret
+
+	/* Entry: three pushes keep rsp 16-byte aligned for helper calls */
+	e.pos = (e.pos + 15) & ~(size_t)15;
+	jit->enter = (jit_enter_fn)(void *)(e.code + e.pos);
+	emit8(&e, 0x53);                                   // push rbx
+	emit8(&e, 0x41); emit8(&e, 0x54);                  // push r12
+	emit8(&e, 0x41); emit8(&e, 0x55);                  // push r13
+	emit8(&e, 0x48); emit8(&e, 0x89); emit8(&e, 0xFB); // mov rbx, rdi
+	emit8(&e, 0x49); emit8(&e, 0x89); emit8(&e, 0xD4); // mov r12, rdx
+	emit8(&e, 0xFF); emit8(&e, 0xE6);                  // jmp rsi
+
+	jit->code_start = (e.pos + 15) & ~(size_t)15;
+	jit->used = jit->code_start;
+}
+
+
+/*** Public ***/
+
+/* Allocate code arena and block tables. Returns NULL if the host isn't supported */
+struct chip8_jit *jit_create(int lockstep)
+{
+	struct chip8_jit *jit = calloc(1, sizeof(struct chip8_jit));
+	if (jit == NULL)
+	{
+		puts("Error allocating JIT.");
+		return NULL;
+	}
+
+	jit->arena = mmap(NULL, JIT_ARENA_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (jit->arena == MAP_FAILED)
+	{
+		puts("Error mapping JIT code arena.");
+		free(jit);
+		return NULL;
+	}
+
+	if (lockstep)
+	{
+		jit->shadow = malloc(sizeof(struct Chip8Memory));
+		if (jit->shadow == NULL) { jit_destroy(jit); return NULL; }
+		jit->lockstep = 1;
+	}
+
+	initialize_decoder();
+	build_handler_classes(jit);
+	emit_trampolines(jit);
+	return jit;
+}
+
+
+/* Free code arena and tables */
+void jit_destroy(struct chip8_jit *jit)
+{
+	if (jit == NULL) { return; }
+	if (jit->machine && jit->machine->jit == jit) { jit->machine->jit = NULL; }
+	munmap(jit->arena, JIT_ARENA_SIZE);
+	free(jit->shadow);
+	free(jit);
+}
+
+
+/* Use jit for machine (drops any blocks translated for a previous machine) */
+void jit_attach(struct chip8_jit *jit, struct Chip8Memory *machine)
+{
+	flush_blocks(jit);
+	jit->machine = machine;
+	jit->diverged = 0;
+	machine->jit = jit;
+}
+
+
+/* Drop blocks translated from [address, address + length) */
+void jit_invalidate(struct chip8_jit *jit, uint32_t address, uint32_t length)
+{
+	uint32_t end = address + length;
+	uint32_t start = (address > MAX_BLOCK_INSTRUCTIONS * 2) ? address - MAX_BLOCK_INSTRUCTIONS * 2 : 0;
+
+	for (; start < end && start < TOTAL_RAM; start++)
+	{
+		if (jit->entry[start] && jit->block_end[start] > address) { jit->entry[start] = NULL; }
+	}
+}
+
+
+/* Name of the first architectural field that differs between a and b, or NULL */
+static const char *first_difference(const struct Chip8Memory *a, const struct Chip8Memory *b)
+{
+	if (memcmp(a->registers, b->registers, sizeof(a->registers)) != 0) { return "registers"; }
+	if (a->index != b->index) { return "I"; }
+	if (a->pc != b->pc) { return "PC"; }
+	if (a->ir != b->ir) { return "IR"; }
+	if (a->sp != b->sp) { return "SP"; }
+	if (a->delay_timer != b->delay_timer) { return "DT"; }
+	if (a->sound_timer != b->sound_timer) { return "ST"; }
+	if (memcmp(a->stack, b->stack, sizeof(a->stack)) != 0) { return "stack"; }
+	if (memcmp(a->ram, b->ram, sizeof(a->ram)) != 0) { return "RAM"; }
+	if (memcmp(a->screen, b->screen, sizeof(a->screen)) != 0) { return "screen"; }
+	if (a->keypad != b->keypad) { return "keypad"; }
+	if (a->key_wait != b->key_wait) { return "WAIT_KEY state"; }
+	if (a->rng != b->rng) { return "RNG state"; }
+	return NULL;
+}
+
+
+/* Run one block on machine and the same instructions on an interpreter copy, compare results */
+static uint64_t lockstep_block(struct chip8_jit *jit, struct Chip8Memory *machine, void *code, uint16_t start, uint64_t executed)
+{
+	uint8_t count = jit->length[start];
+
+	memcpy(jit->shadow, machine, sizeof(struct Chip8Memory));
+	jit->shadow->jit = NULL;
+	jit->shadow->profile = NULL;
+	jit->shadow->debug = NULL;
+	jit->shadow->trace = NULL;
+
+	int64_t left = jit->enter(machine, code, count); // Budget == block length: exactly one block runs
+	execute_cycles(jit->shadow, count - left);
+
+	const char *field = first_difference(machine, jit->shadow);
+	if (field)
+	{
+		jit->diverged = 1;
+		printf("Lockstep divergence in %s after block 0x%03X (%u instructions, %llu executed before it)\n",
+			field, start, count, (unsigned long long)executed);
+		printf("  JIT:    PC=0x%04X I=0x%04X SP=0x%X\n", machine->pc, machine->index, machine->sp);
+		printf("  Interp: PC=0x%04X I=0x%04X SP=0x%X\n", jit->shadow->pc, jit->shadow->index, jit->shadow->sp);
+		for (int i = 0; i < 16; i++)
+		{
+			if (machine->registers[i] != jit->shadow->registers[i])
+			{
+				printf("  V%X: JIT=0x%02X Interp=0x%02X\n", i, machine->registers[i], jit->shadow->registers[i]);
+			}
+		}
+	}
+	return count - left;
+}
+
+
+/* Run count instructions through translated blocks, returns number executed (less on lockstep divergence)
+* - Falls back to the interpreter for single instructions that can't be translated,
+*   or when the next block is longer than the budget left
+*/
+uint64_t jit_execute(struct Chip8Memory *machine, uint64_t count)
+{
+	struct chip8_jit *jit = machine->jit;
+	uint64_t remaining = count;
+
+	while (remaining > 0 && !jit->diverged)
+	{
+		uint64_t idle = idle_cycles(machine, remaining); // Parked on WAIT_KEY, or spinning in an idle loop
+		machine->skipped += idle;
+		remaining -= idle;
+		if (remaining == 0) { break; }
+
+		uint16_t pc = machine->pc;
+		void *code = (pc < TOTAL_RAM) ? jit->entry[pc] : NULL;
+		if (code == NULL) { code = compile_block(jit, machine, pc); }
+
+		if (code == NULL || jit->length[pc] > remaining)
+		{
+			execute_cycles(machine, 1);
+			remaining--;
+		}
+		else if (jit->lockstep)
+		{
+			remaining -= lockstep_block(jit, machine, code, pc, count - remaining);
+		}
+		else
+		{
+			remaining = (uint64_t)jit->enter(machine, code, (int64_t)remaining);
+		}
+	}
+	return count - remaining;
+}
+
+
+/* Non-zero if lockstep mode found a block whose result differs from the interpreter */
+int jit_diverged(const struct chip8_jit *jit)
+{
+	return jit->diverged;
+}
+
+#else // !__x86_64__
+
+struct chip8_jit{
+	int unused;
+};
+
+struct chip8_jit *jit_create(int lockstep)
+{
+	(void)lockstep;
+	puts("JIT is only supported on x86-64 hosts.");
+	return NULL;
+}
+
+void jit_destroy(struct chip8_jit *jit) { (void)jit; }
+void jit_attach(struct chip8_jit *jit, struct Chip8Memory *machine) { (void)jit; (void)machine; }
+uint64_t jit_execute(struct Chip8Memory *machine, uint64_t count) { return execute_cycles(machine, count); }
+void jit_invalidate(struct chip8_jit *jit, uint32_t address, uint32_t length) { (void)jit; (void)address; (void)length; }
+int jit_diverged(const struct chip8_jit *jit) { (void)jit; return 0; }
+
+#endif // __x86_64__
@@ -0,0 +1,50 @@
+/*
+* PotatoCHIP-8 - JIT Header
+*
+* Basic-block dynamic recompiler (x86-64 only)
+*/
+
+/* PUBLIC FUNCTIONS
+   - jit_create()
+   - jit_destroy()
+   - jit_attach()
+   - jit_execute()
+   - jit_invalidate()
+   - jit_diverged()
+
+   PUBLIC STRUCTS
+   - chip8_jit (opaque)
+*/
+
+#ifndef POTATOCHIP_JIT
+#define POTATOCHIP_JIT
+
+#include <stdint.h>
+#include "chip8.h" // struct Chip8Memory
+
+/* Execution core selected with --core (and --lockstep) */
+enum core_mode{
+	CORE_INTERP = 0,
+	CORE_JIT,
+	CORE_JIT_LOCKSTEP, // JIT, with every block checked against the interpreter
+};
+
+/* Allocate code arena and block tables. Returns NULL if the host isn't supported */
+struct chip8_jit *jit_create(int lockstep);
+
+/* Free code arena and tables */
+void jit_destroy(struct chip8_jit *jit);
+
+/* Use jit for machine (drops any blocks translated for a previous machine) */
+void jit_attach(struct chip8_jit *jit, struct Chip8Memory *machine);
+
+/* Run count instructions through translated blocks, returns number executed (less on lockstep divergence) */
+uint64_t jit_execute(struct Chip8Memory *machine, uint64_t count);
+
+/* Drop blocks translated from [address, address + length) */
+void jit_invalidate(struct chip8_jit *jit, uint32_t address, uint32_t length);
+
+/* Non-zero if lockstep mode found a block whose result differs from the interpreter */
+int jit_diverged(const struct chip8_jit *jit);
+
+#endif // POTATOCHIP_JIT
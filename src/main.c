@@ -14,11 +14,20 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
 #include "emulator.h" // loadROM(), initialize_emulator(), shutdown_emulator();
 #include "debugger.h"
+#include "headless.h" // run_headless()
+#include "farm.h" // run_farm()
+#include "analyze.h" // analyze_corpus()
+#include "jit.h" // jit_create(), jit_attach()
+#include "savestate.h" // load_state()
+#include "profile.h" // profile_create(), print_profile()
+#include "trace.h" // trace_open(), trace_close(), trace_diff()
 
 static const char *VERSION = "1.0.0";
-static const char *USAGE = "Usage: ./potatoCHIP8 [-h] [--debug] [--disas] ROM";
+#define DEFAULT_REWIND_MB 8 // Frame history kept by the SDL frontend
+static const char *USAGE = "Usage: ./potatoCHIP8 [-h] [--debug] [--disas] [--ips N] [--turbo] [--keymap FILE] [--seed N] [--load-state FILE] [--save-state FILE] [--rewind-buffer MB] [--profile] [--trace FILE] [--core=jit|interp [--lockstep]] [--headless [--cycles N | --frames N] [--input FILE] [--rewind N] [--until ADDR]] ROM\n       ./potatoCHIP8 --farm LIST [--scripts LIST] [--threads N] (--cycles N | --frames N) [--seed N]\n       ./potatoCHIP8 --analyze DIR [--threads N]\n       ./potatoCHIP8 --trace-diff A B";
 static const char *HELP[] = 
 {
 	"",
@@ -32,14 +41,59 @@ static const char *HELP[] =
 	"\t-v, --version   Show version and exit",
 	"\t--debug         Run graphical debugger alongside ROM",
 	"\t--disas         Print disassembly of ROM and exit",
+	"\t--headless      Run ROM without SDL/ncurses, print final state and exit",
+	"\t--cycles N      Headless: number of instructions to execute",
+	"\t--frames N      Headless: number of 60Hz frames to execute",
+	"\t--input FILE    Headless: input script (\"FRAME KEY down|up\" per line)",
+	"\t--until ADDR    Headless: stop when PC reaches hex ADDR, running like the debugger's 'until'",
+	"\t--farm LIST     Run every ROM listed in LIST headless across worker threads",
+	"\t--scripts LIST  Farm: run every ROM with every input script listed in LIST",
+	"\t--threads N     Farm/analyze: number of worker threads (default: one per CPU)",
+	"\t--analyze DIR   Statically analyze every .ch8 under DIR, print one JSON line per ROM",
+	"\t--ips N         Instructions per second, run in 60Hz frames (default: 540)",
+	"\t--turbo         Run frames as fast as possible instead of pacing them to 60Hz",
+	"\t--seed N        Seed for RAND (Cxkk), same seed = reproducible run (default: from the clock)",
+	"\t--load-state F  Restore machine from state file F after loading the ROM",
+	"\t--save-state F  Headless: write state file F after the run; SDL: F5/F9 slot (default: ROM.state)",
+	"\t--rewind-buffer MB  Frame history size, Backspace rewinds (default: 8 with SDL, 0 = off)",
+	"\t--rewind N      Headless: undo the last N frames after the run (needs history, default 8 MB)",
+	"\t--profile       Count executions per handler/address, print hot spots at exit (interpreter only)",
+	"\t--trace FILE    Record every instruction to FILE (gzip-compressed, built-in interpreter core only: not the JIT, check it with --lockstep; not with --debug)",
+	"\t--trace-diff A B  Print the first instruction where trace files A and B differ",
+	"\t--keymap FILE   Keypad layout (\"SCANCODE_NAME KEY\" per line, e.g. \"X 0\")",
+	"\t--core=CORE     Execution core, 'interp' (default) or 'jit' (x86-64 only)",
+	"\t--lockstep      JIT: check every translated block against the interpreter",
 	0
 };
 
 static struct arguments{ // Arguments to be populated by argparse()
 	int debug;
 	int disas;
+	int headless;
+	unsigned long long cycles;
+	unsigned long long frames;
+	char *input;
+	char *farm;
+	char *scripts;
+	int threads;
+	int jit;
+	int lockstep;
+	unsigned long ips;
+	int turbo;
+	char *keymap;
+	int seeded;
+	unsigned long long seed;
+	char *load_state;
+	char *save_state;
+	long rewind_mb; // -1 = not given
+	unsigned long long rewind_frames;
+	int profile;
+	char *analyze;
+	char *trace;
+	char *trace_diff[2];
+	long until; // -1 = not given
 	char *rom;
-} args={0,0,0};
+} args={0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,-1,0,0,0,0,{0,0},-1,0};
 
 static void argparse(int argc, char **argv) // Parse command-line arguments
 {
@@ -88,6 +142,167 @@ static void argparse(int argc, char **argv) // Parse command-line arguments
         	index += 1;
         	continue;
         }
+        // Headless
+        else if ((strncmp(argv[index], "--headless\0", 11) == 0))
+        {
+        	args.headless = 1;
+        	index += 1;
+        	continue;
+        }
+        // Instruction/frame budgets (headless)
+        else if ((strncmp(argv[index], "--cycles\0", 9) == 0) || (strncmp(argv[index], "--frames\0", 9) == 0))
+        {
+        	if (argv[index + 1] == NULL) { printf("Argument '%s' requires a value\n", argv[index]); exit(-1); }
+
+        	char *end;
+        	unsigned long long value = strtoull(argv[index + 1], &end, 0);
+        	if (*end != '\0' || value == 0) { printf("Invalid value '%s' for '%s'\n", argv[index + 1], argv[index]); exit(-1); }
+
+        	if (argv[index][2] == 'c') { args.cycles = value; }
+        	else { args.frames = value; }
+        	index += 2;
+        	continue;
+        }
+        // Input script, farm ROM list, farm script list, keymap, state to restore
+        else if ((strncmp(argv[index], "--input\0", 8) == 0) || (strncmp(argv[index], "--farm\0", 7) == 0) || (strncmp(argv[index], "--scripts\0", 10) == 0) ||
+        	(strncmp(argv[index], "--keymap\0", 9) == 0) || (strncmp(argv[index], "--load-state\0", 13) == 0))
+        {
+        	if (argv[index + 1] == NULL) { printf("Argument '%s' requires a value\n", argv[index]); exit(-1); }
+        	if (access(argv[index + 1], F_OK) != 0) { printf("File not found '%s'\n", argv[index + 1]); exit(-1); }
+
+        	if (argv[index][2] == 'i') { args.input = argv[index + 1]; }
+        	else if (argv[index][2] == 'f') { args.farm = argv[index + 1]; }
+        	else if (argv[index][2] == 'k') { args.keymap = argv[index + 1]; }
+        	else if (argv[index][2] == 'l') { args.load_state = argv[index + 1]; }
+        	else { args.scripts = argv[index + 1]; }
+        	index += 2;
+        	continue;
+        }
+        // Execution core
+        else if ((strncmp(argv[index], "--core=", 7) == 0))
+        {
+        	if (strcmp(argv[index] + 7, "jit") == 0) { args.jit = 1; }
+        	else if (strcmp(argv[index] + 7, "interp") == 0) { args.jit = 0; }
+        	else { printf("Unknown core '%s'\n", argv[index] + 7); exit(-1); }
+        	index += 1;
+        	continue;
+        }
+        // JIT lockstep check
+        else if ((strncmp(argv[index], "--lockstep\0", 11) == 0))
+        {
+        	args.lockstep = 1;
+        	index += 1;
+        	continue;
+        }
+        // Instructions per second
+        else if ((strncmp(argv[index], "--ips\0", 6) == 0))
+        {
+        	if (argv[index + 1] == NULL) { printf("Argument '%s' requires a value\n", argv[index]); exit(-1); }
+
+        	char *end;
+        	args.ips = strtoul(argv[index + 1], &end, 0);
+        	if (*end != '\0' || args.ips == 0) { printf("Invalid value '%s' for '%s'\n", argv[index + 1], argv[index]); exit(-1); }
+        	index += 2;
+        	continue;
+        }
+        // State to write (may not exist yet)
+        else if ((strncmp(argv[index], "--save-state\0", 13) == 0))
+        {
+        	if (argv[index + 1] == NULL) { printf("Argument '%s' requires a value\n", argv[index]); exit(-1); }
+        	args.save_state = argv[index + 1];
+        	index += 2;
+        	continue;
+        }
+        // Rewind history size (MB), frames to rewind (headless)
+        else if ((strncmp(argv[index], "--rewind-buffer\0", 16) == 0) || (strncmp(argv[index], "--rewind\0", 9) == 0))
+        {
+        	if (argv[index + 1] == NULL) { printf("Argument '%s' requires a value\n", argv[index]); exit(-1); }
+
+        	char *end;
+        	unsigned long long value = strtoull(argv[index + 1], &end, 0);
+        	if (*end != '\0' || ((argv[index][8] == '\0') ? (value == 0) : (value > 4095))) { printf("Invalid value '%s' for '%s'\n", argv[index + 1], argv[index]); exit(-1); }
+
+        	if (argv[index][8] == '\0') { args.rewind_frames = value; }
+        	else { args.rewind_mb = (long)value; }
+        	index += 2;
+        	continue;
+        }
+        // RAND seed
+        else if ((strncmp(argv[index], "--seed\0", 7) == 0))
+        {
+        	if (argv[index + 1] == NULL) { printf("Argument '%s' requires a value\n", argv[index]); exit(-1); }
+
+        	char *end;
+        	args.seed = strtoull(argv[index + 1], &end, 0);
+        	if (*end != '\0') { printf("Invalid value '%s' for '%s'\n", argv[index + 1], argv[index]); exit(-1); }
+        	args.seeded = 1;
+        	index += 2;
+        	continue;
+        }
+        // Profiler
+        else if ((strncmp(argv[index], "--profile\0", 10) == 0))
+        {
+        	args.profile = 1;
+        	index += 1;
+        	continue;
+        }
+        // Unpaced frames
+        else if ((strncmp(argv[index], "--turbo\0", 8) == 0))
+        {
+        	args.turbo = 1;
+        	index += 1;
+        	continue;
+        }
+        // Trace file to write (may not exist yet)
+        else if ((strncmp(argv[index], "--trace\0", 8) == 0))
+        {
+        	if (argv[index + 1] == NULL) { printf("Argument '%s' requires a value\n", argv[index]); exit(-1); }
+        	args.trace = argv[index + 1];
+        	index += 2;
+        	continue;
+        }
+        // Trace files to compare
+        else if ((strncmp(argv[index], "--trace-diff\0", 13) == 0))
+        {
+        	if (argv[index + 1] == NULL || argv[index + 2] == NULL) { printf("Argument '%s' requires two values\n", argv[index]); exit(-1); }
+        	for (int i = 1; i <= 2; i++)
+        	{
+        		if (access(argv[index + i], F_OK) != 0) { printf("File not found '%s'\n", argv[index + i]); exit(-1); }
+        		args.trace_diff[i - 1] = argv[index + i];
+        	}
+        	index += 3;
+        	continue;
+        }
+        // Headless stop address
+        else if ((strncmp(argv[index], "--until\0", 8) == 0))
+        {
+        	if (argv[index + 1] == NULL) { printf("Argument '%s' requires a value\n", argv[index]); exit(-1); }
+
+        	char *end;
+        	unsigned long address = strtoul(argv[index + 1], &end, 16);
+        	if (*end != '\0' || address >= TOTAL_RAM) { printf("Invalid value '%s' for '%s'\n", argv[index + 1], argv[index]); exit(-1); }
+        	args.until = (long)address;
+        	index += 2;
+        	continue;
+        }
+        // ROM corpus to analyze
+        else if ((strncmp(argv[index], "--analyze\0", 10) == 0))
+        {
+        	if (argv[index + 1] == NULL) { printf("Argument '%s' requires a value\n", argv[index]); exit(-1); }
+        	if (access(argv[index + 1], F_OK) != 0) { printf("Directory not found '%s'\n", argv[index + 1]); exit(-1); }
+        	args.analyze = argv[index + 1];
+        	index += 2;
+        	continue;
+        }
+        // Farm worker threads
+        else if ((strncmp(argv[index], "--threads\0", 10) == 0))
+        {
+        	if (argv[index + 1] == NULL) { printf("Argument '%s' requires a value\n", argv[index]); exit(-1); }
+        	args.threads = atoi(argv[index + 1]);
+        	if (args.threads <= 0) { printf("Invalid value '%s' for '%s'\n", argv[index + 1], argv[index]); exit(-1); }
+        	index += 2;
+        	continue;
+        }
 
         /* Positional Argument (ROM) */
 
@@ -107,11 +322,21 @@ static void argparse(int argc, char **argv) // Parse command-line arguments
 	}
 
 	/* Validate Arguments */
-	if (args.rom == 0) 
+	if (args.rom == 0 && args.farm == 0 && args.analyze == 0 && args.trace_diff[0] == 0) 
 	{
 		puts("Argument required 'ROM'\n");
 		exit(-1);
 	}
+	if (args.until >= 0 && !args.headless)
+	{
+		puts("Argument '--until' requires '--headless' (use 'until' in the debugger)");
+		exit(-1);
+	}
+	if (args.debug && args.trace) // Reverse stepping would make the recorded instruction stream non-linear
+	{
+		puts("Argument '--trace' can't be used with '--debug'");
+		exit(-1);
+	}
 }
 
 
@@ -120,15 +345,96 @@ int main(int argc, char **argv)
 	argparse(argc, argv); // Either gathers arguments successfully or exits
 
 	if (args.disas) { disassemble_file(args.rom); return 0; }
+	if (args.analyze) { return (analyze_corpus(args.analyze, args.threads) == 0) ? 0 : -1; }
+	if (args.trace_diff[0]) { return trace_diff(args.trace_diff[0], args.trace_diff[1]); }
 
-	if (initialize_emulator(10) != 0) { return -1; }
+	struct run_options options = {
+		.input = args.input,
+		.cycles = args.cycles,
+		.frames = args.frames,
+		.cycles_per_frame = CYCLES_PER_FRAME,
+		.seed = args.seeded ? args.seed : (uint64_t)time(NULL),
+		.load_state = args.load_state,
+		.save_state = args.save_state,
+		.rewind_frames = args.rewind_frames,
+		.profile = args.profile,
+		.trace = args.trace,
+		.until = (int32_t)args.until,
+		.core = args.jit ? (args.lockstep ? CORE_JIT_LOCKSTEP : CORE_JIT) : CORE_INTERP,
+	};
+	if (args.ips) // Rounded to whole instructions per frame
+	{
+		options.cycles_per_frame = (args.ips + FRAME_RATE / 2) / FRAME_RATE;
+		if (options.cycles_per_frame == 0) { options.cycles_per_frame = 1; }
+	}
+
+	long rewind_mb = args.rewind_mb;
+	if (rewind_mb < 0) { rewind_mb = (args.headless && args.rewind_frames == 0) ? 0 : DEFAULT_REWIND_MB; }
+	options.rewind_size = (size_t)rewind_mb << 20;
+
+	if (args.farm) { return (run_farm(args.farm, args.scripts, args.threads, &options) == 0) ? 0 : -1; }
+
+	if (args.headless) { return (run_headless(args.rom, &options) == 0) ? 0 : -1; }
+
+	/* Same notices as run_headless(): the debugger, tracer, and profiler each run their own interpreter loop */
+	if (args.debug && (options.core != CORE_INTERP || options.profile)) { puts("The debugger runs on the interpreter, --core/--profile ignored"); }
+	else if (options.trace && (options.core != CORE_INTERP || options.profile)) { puts("Tracing runs on the built-in interpreter core, --core/--profile ignored"); }
+	else if (options.profile && options.core != CORE_INTERP) { puts("Profiling runs on the interpreter, --core ignored"); }
+
+	static struct Chip8Memory machine; // Single machine for the SDL frontend
+
+	if (initialize_emulator(&machine, 10) != 0) { return -1; }
+
+	if (loadROM(&machine, args.rom) != 0) { return -1; }
+	seed_rng(&machine, options.seed);
+	if (args.load_state && load_state(&machine, args.load_state) != 0) { shutdown_emulator(); return -1; }
+
+	static char default_state_file[4096];
+	snprintf(default_state_file, sizeof(default_state_file), "%s.state", args.rom);
+	set_state_file(args.save_state ? args.save_state : (args.load_state ? args.load_state : default_state_file));
+
+	struct rewind_buffer *history = NULL;
+	if (options.rewind_size && !args.debug)
+	{
+		history = rewind_create(options.rewind_size);
+		if (history == NULL) { shutdown_emulator(); return -1; }
+		set_rewind_buffer(history);
+	}
+
+	if (args.keymap && load_keymap(args.keymap) != 0) { shutdown_emulator(); return -1; }
+
+	struct chip8_trace *trace = NULL;
+	if (options.trace)
+	{
+		trace = trace_open(options.trace);
+		if (trace == NULL) { shutdown_emulator(); return -1; }
+		machine.trace = trace;
+	}
 
-	if (loadROM(args.rom) != 0) { return -1; }
+	struct chip8_profile *profile = NULL;
+	if (options.profile && trace == NULL && !args.debug)
+	{
+		profile = profile_create();
+		if (profile == NULL) { shutdown_emulator(); return -1; }
+		machine.profile = profile;
+	}
+
+	struct chip8_jit *jit = NULL;
+	if (options.core != CORE_INTERP && !args.debug && profile == NULL && trace == NULL)
+	{
+		jit = jit_create(options.core == CORE_JIT_LOCKSTEP);
+		if (jit == NULL) { shutdown_emulator(); return -1; }
+		jit_attach(jit, &machine);
+	}
 
-	if (args.debug) { cmd_debug(); }
-	else { start_emulator(); }
+	if (args.debug) { cmd_debug(&machine); }
+	else { start_emulator(&machine, options.cycles_per_frame, args.turbo); }
 
 	shutdown_emulator();
+	if (jit) { jit_destroy(jit); }
+	rewind_destroy(history);
+	if (profile) { print_profile(profile, &machine); profile_destroy(profile); }
+	trace_close(trace);
 	puts("\nPotatoCHIP-8 exited gracefully.");
 	return 0;
 }
@@ -0,0 +1,91 @@
+/*
+* PotatoCHIP-8 - Profiler
+*
+* Counters are filled by execute_cycles() in chip8.c, which
+* switches to a separate instrumented loop while a profile is
+* attached; this file only allocates them and prints the report.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "chip8.h" // struct Chip8Memory, handler_name()
+#include "debugger.h" // disassemble_instruction()
+#include "profile.h"
+
+
+/* Allocate zeroed counters */
+struct chip8_profile *profile_create(void)
+{
+	struct chip8_profile *profile = calloc(1, sizeof(struct chip8_profile));
+	if (profile == NULL) { puts("Error allocating profile."); }
+	return profile;
+}
+
+
+/* Free counters */
+void profile_destroy(struct chip8_profile *profile)
+{
+	free(profile);
+}
+
+
+static const uint64_t *sort_counts; // qsort() has no context argument
+
+/* Order indexes by descending count */
+static int by_count(const void *a, const void *b)
+{
+	uint64_t x = sort_counts[*(const uint16_t *)a];
+	uint64_t y = sort_counts[*(const uint16_t *)b];
+	return (x < y) - (x > y);
+}
+
+static double percent(uint64_t part, uint64_t whole)
+{
+	return whole ? 100.0 * (double)part / (double)whole : 0.0;
+}
+
+
+/* Print totals, handlers by count, and the hottest addresses disassembled from machine RAM */
+void print_profile(const struct chip8_profile *profile, const struct Chip8Memory *machine)
+{
+	uint64_t executed = profile->instructions;
+	double total_ms = profile->total_ns / 1e6;
+	double draw_ms = profile->draw_ns / 1e6;
+
+	printf("\nProfile:\n");
+	printf("Frames:           %llu\n", (unsigned long long)profile->frames);
+	printf("Instructions:     %llu executed, %llu fast-forwarded\n", (unsigned long long)executed, (unsigned long long)profile->idle);
+	printf("Time executing:   %.3f ms\n", total_ms);
+	printf("Time in DRAW:     %.3f ms (%.1f%%), rest %.3f ms\n", draw_ms, percent(profile->draw_ns, profile->total_ns), total_ms - draw_ms);
+
+	static uint16_t order[TOTAL_RAM];
+	size_t used = 0;
+
+	for (uint16_t i = 0; i < PROFILE_HANDLER_SLOTS; i++) { if (profile->handler_count[i]) { order[used++] = i; } }
+	sort_counts = profile->handler_count;
+	qsort(order, used, sizeof(order[0]), by_count);
+
+	printf("\n%-14s %14s %7s\n", "Handler", "Count", "%");
+	for (size_t i = 0; i < used; i++)
+	{
+		printf("%-14s %14llu %6.2f%%\n", handler_name((uint8_t)order[i]),
+			(unsigned long long)profile->handler_count[order[i]], percent(profile->handler_count[order[i]], executed));
+	}
+
+	used = 0;
+	for (uint16_t pc = 0; pc < TOTAL_RAM; pc++) { if (profile->pc_count[pc]) { order[used++] = pc; } }
+	sort_counts = profile->pc_count;
+	qsort(order, used, sizeof(order[0]), by_count);
+
+	printf("\n%-7s %-22s %14s %7s\n", "Address", "Instruction", "Count", "%");
+	for (size_t i = 0; i < used && i < PROFILE_HOT_SPOTS; i++)
+	{
+		uint16_t pc = order[i];
+		char mnemonic[32];
+		disassemble_instruction(mnemonic, sizeof(mnemonic), (uint16_t)(machine->ram[pc] << 8u | machine->ram[(pc + 1) % TOTAL_RAM]));
+		printf("0x%03X   %-22s %14llu %6.2f%%\n", pc, mnemonic, (unsigned long long)profile->pc_count[pc], percent(profile->pc_count[pc], executed));
+	}
+}
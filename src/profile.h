@@ -0,0 +1,45 @@
+/*
+* PotatoCHIP-8 - Profiler Header
+*
+* Per-handler/per-address execution counts (--profile)
+*/
+
+/* PUBLIC FUNCTIONS
+   - profile_create()
+   - profile_destroy()
+   - print_profile()
+
+   PUBLIC STRUCTS
+   - chip8_profile
+*/
+
+#ifndef POTATOCHIP_PROFILE
+#define POTATOCHIP_PROFILE
+
+#include <stdint.h>
+#include "chip8.h" // struct Chip8Memory, TOTAL_RAM
+
+#define PROFILE_HANDLER_SLOTS 64 // >= number of interpreter handlers (+1 for UNDECODED)
+#define PROFILE_HOT_SPOTS 20 // Addresses listed in the report
+
+/* Counters filled while attached to machine->profile (see execute_cycles()) */
+struct chip8_profile{
+	uint64_t handler_count[PROFILE_HANDLER_SLOTS]; // Executions per handler index
+	uint64_t pc_count[TOTAL_RAM];  // Executions per instruction address
+	uint64_t instructions;         // Executed one by one
+	uint64_t idle;                 // Fast-forwarded (idle loops, WAIT_KEY)
+	uint64_t frames;               // Counted by the frame loops
+	uint64_t draw_ns;              // Time inside DRAW
+	uint64_t total_ns;             // Time inside execute_cycles()
+};
+
+/* Allocate zeroed counters. Returns NULL on failure */
+struct chip8_profile *profile_create(void);
+
+/* Free counters */
+void profile_destroy(struct chip8_profile *profile);
+
+/* Print totals, handlers by count, and the hottest addresses disassembled from machine RAM */
+void print_profile(const struct chip8_profile *profile, const struct Chip8Memory *machine);
+
+#endif // POTATOCHIP_PROFILE
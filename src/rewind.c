@@ -0,0 +1,296 @@
+/*
+* PotatoCHIP-8 - Rewind
+*
+* History of per-frame machine states in a fixed-size byte ring.
+* Every record is either a keyframe (the whole MACHINE_STATE_SIZE
+* state block) or the XOR of the state against the previous frame,
+* run-length encoded as (skip, length, XOR bytes) runs. Between
+* frames only a few registers, timers, the RNG, and the rows DRAW
+* touched change, so most deltas are a few dozen bytes.
+*
+* A keyframe is written every REWIND_KEYFRAME_INTERVAL frames (or
+* when a delta would be larger), and the oldest frames are always
+* dropped back to a keyframe, so every frame still held can be
+* rebuilt from the keyframe before it plus at most that many deltas.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include "chip8.h" // struct Chip8Memory, MACHINE_STATE_SIZE, invalidate_decoded()
+#include "rewind.h"
+
+
+#define RECORD_KEYFRAME 'K' // First byte of every record
+#define RECORD_DELTA 'D'
+#define RUN_HEADER 4 // uint16_t skip + uint16_t length
+#define RING_BYTES_PER_ENTRY 64 // Entry table size relative to the ring (typical delta is smaller)
+
+struct rewind_entry{
+	uint32_t offset; // Record position in the ring
+	uint32_t size;   // Record size including its type byte (never 0)
+};
+
+struct rewind_buffer{
+	uint8_t *data;                  // Byte ring of records
+	size_t capacity;
+	size_t head;                    // Offset the next record is written at
+	struct rewind_entry *entries;   // Ring of records, oldest at first
+	size_t max_entries;
+	size_t first;
+	size_t count;
+	uint64_t bytes;                 // Sum of held record sizes
+	uint64_t keyframes;             // Keyframes among held records
+	uint32_t since_keyframe;        // Deltas written since the last keyframe
+	uint64_t captured;
+	uint64_t capture_ns;
+	uint8_t previous[MACHINE_STATE_SIZE]; // State of the newest record
+	uint8_t scratch[MACHINE_STATE_SIZE + 1]; // Record being encoded
+};
+
+
+/* Allocate ring of size bytes and an entry table to match */
+struct rewind_buffer *rewind_create(size_t size)
+{
+	if (size < 4 * (MACHINE_STATE_SIZE + 1) || size > UINT32_MAX)
+	{
+		printf("Rewind buffer must be between %zu bytes and 4 GB\n", 4 * (MACHINE_STATE_SIZE + 1));
+		return NULL;
+	}
+
+	struct rewind_buffer *rewind = calloc(1, sizeof(struct rewind_buffer));
+	if (rewind == NULL) { return NULL; }
+
+	rewind->capacity = size;
+	rewind->max_entries = size / RING_BYTES_PER_ENTRY;
+	rewind->data = malloc(size);
+	rewind->entries = malloc(rewind->max_entries * sizeof(struct rewind_entry));
+	if (rewind->data == NULL || rewind->entries == NULL)
+	{
+		puts("Error allocating rewind buffer.");
+		rewind_destroy(rewind);
+		return NULL;
+	}
+	return rewind;
+}
+
+
+/* Free ring and entry table */
+void rewind_destroy(struct rewind_buffer *rewind)
+{
+	if (rewind == NULL) { return; }
+	free(rewind->data);
+	free(rewind->entries);
+	free(rewind);
+}
+
+
+/* Entry i records after the oldest */
+static struct rewind_entry *entry_at(struct rewind_buffer *rewind, size_t i)
+{
+	return &rewind->entries[(rewind->first + i) % rewind->max_entries];
+}
+
+static int is_keyframe(const struct rewind_buffer *rewind, const struct rewind_entry *entry)
+{
+	return rewind->data[entry->offset] == RECORD_KEYFRAME;
+}
+
+static void forget(struct rewind_buffer *rewind, const struct rewind_entry *entry)
+{
+	rewind->bytes -= entry->size;
+	if (is_keyframe(rewind, entry)) { rewind->keyframes--; }
+	rewind->count--;
+}
+
+static void drop_oldest(struct rewind_buffer *rewind)
+{
+	forget(rewind, entry_at(rewind, 0));
+	rewind->first = (rewind->first + 1) % rewind->max_entries;
+}
+
+static void drop_newest(struct rewind_buffer *rewind)
+{
+	forget(rewind, entry_at(rewind, rewind->count - 1));
+}
+
+
+/* XOR previous ^ current as (skip, length, bytes) runs after the type byte
+* - Equal gaps shorter than a run header are folded into the surrounding run
+* - Returns record size, or 0 if it wouldn't be smaller than a keyframe
+*/
+static size_t encode_delta(const uint8_t *previous, const uint8_t *current, uint8_t *out)
+{
+	size_t pos = 1;
+	size_t last = 0; // End of the previous run
+	size_t i = 0;
+	out[0] = RECORD_DELTA;
+
+	while (i < MACHINE_STATE_SIZE)
+	{
+		while (i + 8 <= MACHINE_STATE_SIZE) // Skip unchanged bytes a word at a time
+		{
+			uint64_t a, b;
+			memcpy(&a, previous + i, 8);
+			memcpy(&b, current + i, 8);
+			if (a != b) { break; }
+			i += 8;
+		}
+		while (i < MACHINE_STATE_SIZE && previous[i] == current[i]) { i++; }
+		if (i == MACHINE_STATE_SIZE) { break; }
+
+		size_t start = i;
+		while (i < MACHINE_STATE_SIZE)
+		{
+			if (previous[i] != current[i]) { i++; continue; }
+			size_t gap = 1;
+			while (gap < RUN_HEADER && i + gap < MACHINE_STATE_SIZE && previous[i + gap] == current[i + gap]) { gap++; }
+			if (gap == RUN_HEADER || i + gap == MACHINE_STATE_SIZE) { break; }
+			i += gap;
+		}
+
+		uint16_t skip = (uint16_t)(start - last);
+		uint16_t length = (uint16_t)(i - start);
+		if (pos + RUN_HEADER + length >= MACHINE_STATE_SIZE + 1) { return 0; }
+
+		memcpy(out + pos, &skip, 2);
+		memcpy(out + pos + 2, &length, 2);
+		pos += RUN_HEADER;
+		for (size_t j = start; j < i; j++) { out[pos++] = previous[j] ^ current[j]; }
+		last = i;
+	}
+	return pos;
+}
+
+/* XOR delta record into state (turns the previous frame's state into this one's) */
+static void apply_delta(uint8_t *state, const uint8_t *record, size_t size)
+{
+	size_t offset = 0;
+	for (size_t pos = 1; pos < size;)
+	{
+		uint16_t skip, length;
+		memcpy(&skip, record + pos, 2);
+		memcpy(&length, record + pos + 2, 2);
+		pos += RUN_HEADER;
+		offset += skip;
+		for (uint16_t j = 0; j < length; j++) { state[offset++] ^= record[pos++]; }
+	}
+}
+
+
+/* Make room for a size-byte record at head, dropping the oldest records (back to a keyframe) it overwrites */
+static void reserve(struct rewind_buffer *rewind, size_t size)
+{
+	if (rewind->head + size > rewind->capacity) { rewind->head = 0; }
+
+	while (rewind->count > 0)
+	{
+		const struct rewind_entry *oldest = entry_at(rewind, 0);
+		int overlaps = oldest->offset < rewind->head + size && oldest->offset + oldest->size > rewind->head;
+		if (!overlaps && rewind->count < rewind->max_entries) { break; }
+		drop_oldest(rewind);
+	}
+	while (rewind->count > 0 && !is_keyframe(rewind, entry_at(rewind, 0))) { drop_oldest(rewind); }
+}
+
+static void append(struct rewind_buffer *rewind, const uint8_t *record, size_t size)
+{
+	struct rewind_entry *entry = entry_at(rewind, rewind->count);
+	entry->offset = (uint32_t)rewind->head;
+	entry->size = (uint32_t)size;
+	memcpy(rewind->data + rewind->head, record, size);
+
+	rewind->head += size;
+	rewind->count++;
+	rewind->bytes += size;
+	if (record[0] == RECORD_KEYFRAME) { rewind->keyframes++; }
+}
+
+
+/* Record machine state at the end of a frame
+* - Delta against the previous capture, or a keyframe every REWIND_KEYFRAME_INTERVAL frames,
+*   when the delta isn't smaller, or when eviction left no keyframe to build on
+*/
+void rewind_capture(struct rewind_buffer *rewind, struct Chip8Memory *machine)
+{
+	struct timespec start, stop;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	const uint8_t *current = (const uint8_t *)machine;
+	size_t size = 0;
+	if (rewind->count > 0 && rewind->since_keyframe < REWIND_KEYFRAME_INTERVAL)
+	{
+		size = encode_delta(rewind->previous, current, rewind->scratch);
+		if (size) { reserve(rewind, size); }
+		if (rewind->count == 0) { size = 0; } // Base frame was evicted
+	}
+
+	if (size == 0)
+	{
+		rewind->scratch[0] = RECORD_KEYFRAME;
+		memcpy(rewind->scratch + 1, current, MACHINE_STATE_SIZE);
+		size = MACHINE_STATE_SIZE + 1;
+		reserve(rewind, size);
+		rewind->since_keyframe = 0;
+	}
+	else { rewind->since_keyframe++; }
+
+	append(rewind, rewind->scratch, size);
+	memcpy(rewind->previous, current, MACHINE_STATE_SIZE);
+
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	rewind->captured++;
+	rewind->capture_ns += (uint64_t)((stop.tv_sec - start.tv_sec) * 1000000000LL + (stop.tv_nsec - start.tv_nsec));
+}
+
+
+/* Restore the state frames captures before the latest one
+* - frames == 0 restores the latest capture; clamped to the oldest frame held
+* - Newer history is dropped, capturing continues from the restored frame
+* - Only the RAM range that actually changed is invalidated in the predecode cache/JIT
+*/
+uint64_t rewind_step(struct rewind_buffer *rewind, struct Chip8Memory *machine, uint64_t frames)
+{
+	if (rewind->count == 0) { return 0; }
+	if (frames > rewind->count - 1) { frames = rewind->count - 1; }
+
+	size_t target = rewind->count - 1 - frames;
+	size_t key = target;
+	while (!is_keyframe(rewind, entry_at(rewind, key))) { key--; } // Oldest record is always a keyframe
+
+	memcpy(rewind->previous, rewind->data + entry_at(rewind, key)->offset + 1, MACHINE_STATE_SIZE);
+	for (size_t i = key + 1; i <= target; i++)
+	{
+		const struct rewind_entry *entry = entry_at(rewind, i);
+		apply_delta(rewind->previous, rewind->data + entry->offset, entry->size);
+	}
+
+	while (rewind->count > target + 1) { drop_newest(rewind); }
+	const struct rewind_entry *newest = entry_at(rewind, target);
+	rewind->head = newest->offset + newest->size;
+	rewind->since_keyframe = (uint32_t)(target - key);
+
+	const uint8_t *restored_ram = rewind->previous + offsetof(struct Chip8Memory, ram);
+	uint32_t low = 0, high = TOTAL_RAM;
+	while (low < high && machine->ram[low] == restored_ram[low]) { low++; }
+	while (high > low && machine->ram[high - 1] == restored_ram[high - 1]) { high--; }
+
+	memcpy(machine, rewind->previous, MACHINE_STATE_SIZE);
+	machine->dirty_rows = 0xFFFFFFFF;
+	invalidate_decoded(machine, low, high - low);
+	return frames;
+}
+
+
+/* Print history size and average capture cost (also as a share of a 60Hz frame) */
+void print_rewind_stats(const struct rewind_buffer *rewind)
+{
+	double average_ns = rewind->captured ? (double)rewind->capture_ns / rewind->captured : 0.0;
+	printf("Rewind history:   %zu frames (%llu keyframes) in %llu bytes\n",
+		rewind->count, (unsigned long long)rewind->keyframes, (unsigned long long)rewind->bytes);
+	printf("Rewind capture:   %.0f ns/frame (%.4f%% of a frame)\n", average_ns, average_ns * FRAME_RATE / 1e7);
+}
@@ -0,0 +1,44 @@
+/*
+* PotatoCHIP-8 - Rewind Header
+*
+* Per-frame history of machine states
+*/
+
+/* PUBLIC FUNCTIONS
+   - rewind_create()
+   - rewind_destroy()
+   - rewind_capture()
+   - rewind_step()
+   - print_rewind_stats()
+
+   PUBLIC STRUCTS
+   - rewind_buffer (opaque)
+*/
+
+#ifndef POTATOCHIP_REWIND
+#define POTATOCHIP_REWIND
+
+#include <stdint.h>
+#include <stddef.h>
+#include "chip8.h" // struct Chip8Memory, MACHINE_STATE_SIZE
+
+#define REWIND_KEYFRAME_INTERVAL 600 // Frames between full states (10 s at 60Hz)
+
+struct rewind_buffer;
+
+/* Allocate history ring of size bytes. Returns NULL on failure */
+struct rewind_buffer *rewind_create(size_t size);
+
+/* Free history ring */
+void rewind_destroy(struct rewind_buffer *rewind);
+
+/* Record machine state at the end of a frame (oldest frames are dropped when the ring is full) */
+void rewind_capture(struct rewind_buffer *rewind, struct Chip8Memory *machine);
+
+/* Restore the state frames captures before the latest one, dropping newer history. Returns frames actually rewound */
+uint64_t rewind_step(struct rewind_buffer *rewind, struct Chip8Memory *machine, uint64_t frames);
+
+/* Print history size and average capture cost (also as a share of a 60Hz frame) */
+void print_rewind_stats(const struct rewind_buffer *rewind);
+
+#endif // POTATOCHIP_REWIND
@@ -0,0 +1,133 @@
+/*
+* PotatoCHIP-8 - Save States
+*
+* A state file is a struct state_header followed by the raw
+* emulated-state prefix of struct Chip8Memory (registers, stack,
+* timers, RAM, framebuffer, keypad, WAIT_KEY state, RNG). There
+* is nothing to parse: loading maps the file, rejects values the
+* emulator could never be in, and copies the block back in place.
+* Files are only portable between builds with the same layout,
+* which the version/size check enforces.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "chip8.h" // struct Chip8Memory, MACHINE_STATE_SIZE, invalidate_decoded()
+#include "savestate.h"
+
+
+/* Write header and state block to path
+* - Written to path.tmp first and renamed over path, so a crash never leaves a torn file
+*/
+int save_state(const struct Chip8Memory *machine, const char *path)
+{
+	struct state_header header = { STATE_MAGIC, STATE_VERSION, (uint32_t)MACHINE_STATE_SIZE };
+
+	size_t length = strlen(path);
+	char *tmp_path = malloc(length + 5);
+	if (tmp_path == NULL) { return -1; }
+	memcpy(tmp_path, path, length);
+	memcpy(tmp_path + length, ".tmp", 5);
+
+	FILE *fp = fopen(tmp_path, "wb");
+	if (fp == NULL)
+	{
+		printf("Error opening state file '%s'\n", tmp_path);
+		free(tmp_path);
+		return -1;
+	}
+
+	int ok = fwrite(&header, sizeof(header), 1, fp) == 1 && fwrite(machine, MACHINE_STATE_SIZE, 1, fp) == 1;
+	ok = (fclose(fp) == 0) && ok;
+	if (!ok || rename(tmp_path, path) != 0)
+	{
+		printf("Error writing state file '%s'\n", path);
+		remove(tmp_path);
+		free(tmp_path);
+		return -1;
+	}
+	free(tmp_path);
+	return 0;
+}
+
+
+/* Reason the state block (MACHINE_STATE_SIZE bytes, possibly unaligned) can't be a machine state, or NULL if it can
+* - sp must index the stack, or CALL/RET would write outside it
+* - key_wait is 0 or 0x10 | x, rng is never 0 (see seed_rng())
+*/
+static const char *invalid_state(const uint8_t *state)
+{
+	uint8_t sp, key_wait;
+	uint64_t rng;
+	memcpy(&sp, state + offsetof(struct Chip8Memory, sp), sizeof(sp));
+	memcpy(&key_wait, state + offsetof(struct Chip8Memory, key_wait), sizeof(key_wait));
+	memcpy(&rng, state + offsetof(struct Chip8Memory, rng), sizeof(rng));
+
+	if (sp >= STACK_SIZE) { return "stack pointer out of range"; }
+	if (key_wait != 0 && (key_wait & 0xF0) != 0x10) { return "bad WAIT_KEY state"; }
+	if (rng == 0) { return "RNG state is 0"; }
+	return NULL;
+}
+
+
+/* Map state file, check header and fields, copy state block into machine
+* - Predecoded instructions and JIT blocks are dropped, the whole screen is redrawn
+* - machine is left untouched if the file is missing, truncated, from another layout, or holds impossible values
+*/
+int load_state(struct Chip8Memory *machine, const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		printf("Error opening state file '%s'\n", path);
+		return -1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size != (off_t)(sizeof(struct state_header) + MACHINE_STATE_SIZE))
+	{
+		printf("State file '%s' has the wrong size\n", path);
+		close(fd);
+		return -1;
+	}
+
+	const uint8_t *file = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (file == MAP_FAILED)
+	{
+		printf("Error mapping state file '%s'\n", path);
+		return -1;
+	}
+
+	const struct state_header *header = (const struct state_header *)file;
+	if (memcmp(header->magic, STATE_MAGIC, sizeof(header->magic)) != 0 ||
+		header->version != STATE_VERSION || header->state_size != MACHINE_STATE_SIZE)
+	{
+		printf("State file '%s' is not a version %d state of this build\n", path, STATE_VERSION);
+		munmap((void *)file, st.st_size);
+		return -1;
+	}
+
+	const char *invalid = invalid_state(file + sizeof(struct state_header));
+	if (invalid)
+	{
+		printf("State file '%s' is corrupt (%s)\n", path, invalid);
+		munmap((void *)file, st.st_size);
+		return -1;
+	}
+
+	memcpy(machine, file + sizeof(struct state_header), MACHINE_STATE_SIZE);
+	munmap((void *)file, st.st_size);
+
+	machine->dirty_rows = 0xFFFFFFFF;
+	invalidate_decoded(machine, 0, TOTAL_RAM);
+	return 0;
+}
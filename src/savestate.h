@@ -0,0 +1,37 @@
+/*
+* PotatoCHIP-8 - Save State Header
+*
+* Snapshot files of a whole machine
+*/
+
+/* PUBLIC FUNCTIONS
+   - save_state()
+   - load_state()
+
+   PUBLIC STRUCTS
+   - state_header
+*/
+
+#ifndef POTATOCHIP_SAVESTATE
+#define POTATOCHIP_SAVESTATE
+
+#include <stdint.h>
+#include "chip8.h" // struct Chip8Memory, MACHINE_STATE_SIZE
+
+#define STATE_MAGIC "P8STATE" // 8 bytes with the terminator
+#define STATE_VERSION 1
+
+/* File header, followed directly by the first MACHINE_STATE_SIZE bytes of struct Chip8Memory */
+struct state_header{
+	char magic[8];       // STATE_MAGIC
+	uint32_t version;    // STATE_VERSION
+	uint32_t state_size; // MACHINE_STATE_SIZE of the build that wrote the file
+};
+
+/* Write machine state to path (replaced atomically) */
+int save_state(const struct Chip8Memory *machine, const char *path);
+
+/* Restore machine state from path written by save_state() */
+int load_state(struct Chip8Memory *machine, const char *path);
+
+#endif // POTATOCHIP_SAVESTATE
@@ -0,0 +1,315 @@
+/*
+* PotatoCHIP-8 - Execution Trace
+*
+* Records one fixed-width struct trace_entry (every register after the
+* instruction, plus a mask of those it changed) per executed instruction
+* into a gzip file. Entries are collected in blocks on the emulation
+* thread; full blocks are queued to a writer thread that compresses
+* and writes them, and handed back for reuse once written. If the
+* writer falls behind, another block is allocated rather than waiting
+* for it, so the emulation thread never blocks on compression or disk.
+* Every block ends with a zlib sync flush, so a trace cut short by a
+* crash still decompresses up to its last written block.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "chip8.h" // struct Chip8Memory
+#include "debugger.h" // disassemble_instruction(), MNEMONIC_MAX
+#include "trace.h"
+
+
+#define TRACE_BLOCK_ENTRIES 16384 // Entries per block (448 KB)
+#define TRACE_CONTEXT 8 // Matching instructions printed before a divergence
+
+_Static_assert(sizeof(struct trace_entry) == 28, "trace entries must stay fixed width");
+
+struct trace_block{
+	struct trace_block *next;
+	size_t count;
+	struct trace_entry entries[TRACE_BLOCK_ENTRIES];
+};
+
+struct chip8_trace{
+	gzFile file;
+	const char *path;
+	struct trace_block *current; // Being filled by the emulation thread
+	pthread_t writer;
+	pthread_mutex_t lock;        // Guards everything below
+	pthread_cond_t queued;
+	struct trace_block *queue;   // Full blocks, oldest first
+	struct trace_block *queue_last;
+	struct trace_block *free;    // Written blocks ready for reuse
+	size_t blocks;               // Blocks allocated
+	int closing;
+	int error;                   // Writer failed, later blocks are dropped
+	uint64_t entries;            // Entries handed to the writer
+};
+
+
+/* Compress and write queued blocks until closing and the queue is empty */
+static void *write_blocks(void *arg)
+{
+	struct chip8_trace *trace = arg;
+
+	pthread_mutex_lock(&trace->lock);
+	while (1)
+	{
+		while (trace->queue == NULL && !trace->closing) { pthread_cond_wait(&trace->queued, &trace->lock); }
+		struct trace_block *block = trace->queue;
+		if (block == NULL) { break; } // Closing, nothing left
+		trace->queue = block->next;
+		int error = trace->error;
+		pthread_mutex_unlock(&trace->lock);
+
+		size_t size = block->count * sizeof(struct trace_entry);
+		if (!error && (gzwrite(trace->file, block->entries, size) != (int)size || gzflush(trace->file, Z_SYNC_FLUSH) != Z_OK)) { error = 1; }
+
+		pthread_mutex_lock(&trace->lock);
+		trace->error |= error;
+		block->next = trace->free;
+		trace->free = block;
+	}
+	pthread_mutex_unlock(&trace->lock);
+	return NULL;
+}
+
+
+/* Create file, write header, start writer thread */
+struct chip8_trace *trace_open(const char *path)
+{
+	struct chip8_trace *trace = calloc(1, sizeof(struct chip8_trace));
+	if (trace == NULL) { return NULL; }
+	trace->path = path;
+	trace->current = malloc(sizeof(struct trace_block));
+	trace->file = gzopen(path, "wb1"); // Fastest level, keeps the writer ahead of the emulator
+	if (trace->current == NULL || trace->file == NULL)
+	{
+		printf("Error creating trace file '%s'\n", path);
+		if (trace->file) { gzclose(trace->file); }
+		free(trace->current);
+		free(trace);
+		return NULL;
+	}
+	trace->current->count = 0;
+	trace->blocks = 1;
+	gzbuffer(trace->file, 1 << 20);
+
+	struct trace_header header = { .entry_size = sizeof(struct trace_entry) };
+	memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+	gzwrite(trace->file, &header, sizeof(header));
+
+	pthread_mutex_init(&trace->lock, NULL);
+	pthread_cond_init(&trace->queued, NULL);
+	if (pthread_create(&trace->writer, NULL, write_blocks, trace) != 0)
+	{
+		puts("Error starting trace writer thread.");
+		gzclose(trace->file);
+		free(trace->current);
+		free(trace);
+		return NULL;
+	}
+	return trace;
+}
+
+
+/* Queue the current block for the writer and start a new one (reused, or allocated if the writer is behind) */
+static void submit_block(struct chip8_trace *trace)
+{
+	struct trace_block *block = trace->current;
+	block->next = NULL;
+
+	pthread_mutex_lock(&trace->lock);
+	if (trace->queue) { trace->queue_last->next = block; }
+	else { trace->queue = block; }
+	trace->queue_last = block;
+	trace->entries += block->count;
+	struct trace_block *next = trace->free;
+	if (next) { trace->free = next->next; }
+	pthread_cond_signal(&trace->queued);
+	pthread_mutex_unlock(&trace->lock);
+
+	if (next == NULL)
+	{
+		next = malloc(sizeof(struct trace_block));
+		if (next == NULL) { puts("Error allocating trace block."); exit(-1); }
+		trace->blocks++;
+	}
+	next->count = 0;
+	trace->current = next;
+}
+
+
+/* Flush, join writer, close file */
+void trace_close(struct chip8_trace *trace)
+{
+	if (trace == NULL) { return; }
+	if (trace->current->count) { submit_block(trace); }
+
+	pthread_mutex_lock(&trace->lock);
+	trace->closing = 1;
+	pthread_cond_signal(&trace->queued);
+	pthread_mutex_unlock(&trace->lock);
+	pthread_join(trace->writer, NULL);
+
+	int error = trace->error | (gzclose(trace->file) != Z_OK);
+	struct stat file_stat;
+	double compressed = (stat(trace->path, &file_stat) == 0) ? (double)file_stat.st_size : 0.0;
+	double raw = (double)(sizeof(struct trace_header) + trace->entries * sizeof(struct trace_entry));
+	if (error) { printf("Error writing trace file '%s'\n", trace->path); }
+	printf("Trace:            %s (%llu instructions, %.1f MB -> %.1f MB, %zu blocks)\n", trace->path,
+		(unsigned long long)trace->entries, raw / (1 << 20), compressed / (1 << 20), trace->blocks);
+
+	free(trace->current);
+	while (trace->free)
+	{
+		struct trace_block *next = trace->free->next;
+		free(trace->free);
+		trace->free = next;
+	}
+	pthread_mutex_destroy(&trace->lock);
+	pthread_cond_destroy(&trace->queued);
+	free(trace);
+}
+
+
+/* Append entry for the instruction that just ran, called for every instruction while tracing */
+void trace_record(struct chip8_trace *trace, const struct Chip8Memory *machine, uint16_t pc, uint16_t opcode, const uint8_t registers[16])
+{
+	struct trace_entry *entry = &trace->current->entries[trace->current->count];
+	uint16_t changed = 0;
+
+	if (memcmp(registers, machine->registers, sizeof(machine->registers)) != 0)
+	{
+		for (int i = 0; i < 16; i++) { changed |= (uint16_t)(registers[i] != machine->registers[i]) << i; }
+	}
+	entry->pc = pc;
+	entry->opcode = opcode;
+	entry->index = machine->index;
+	entry->changed = changed;
+	entry->sp = machine->sp;
+	entry->delay_timer = machine->delay_timer;
+	entry->sound_timer = machine->sound_timer;
+	entry->reserved = 0;
+	memcpy(entry->registers, machine->registers, sizeof(entry->registers));
+
+	if (++trace->current->count == TRACE_BLOCK_ENTRIES) { submit_block(trace); }
+}
+
+
+/* Open trace file and check its header, returns NULL on error */
+static gzFile open_trace(const char *path)
+{
+	gzFile file = gzopen(path, "rb");
+	struct trace_header header;
+	if (file == NULL) { printf("Error opening trace file '%s'\n", path); return NULL; }
+	if (gzread(file, &header, sizeof(header)) != sizeof(header) || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+		header.entry_size != sizeof(struct trace_entry))
+	{
+		printf("Not a PotatoCHIP-8 trace: '%s'\n", path);
+		gzclose(file);
+		return NULL;
+	}
+	gzbuffer(file, 1 << 20);
+	return file;
+}
+
+/* Read up to max entries, returns count read (a partial entry at a truncated end is ignored) */
+static size_t read_entries(gzFile file, struct trace_entry *entries, size_t max)
+{
+	int bytes = gzread(file, entries, max * sizeof(struct trace_entry));
+	return (bytes > 0) ? (size_t)bytes / sizeof(struct trace_entry) : 0;
+}
+
+/* Print one entry with its disassembly and the registers it changed */
+static void print_entry(const char *label, uint64_t number, const struct trace_entry *entry)
+{
+	char mnemonic[MNEMONIC_MAX + 1];
+	disassemble_instruction(mnemonic, sizeof(mnemonic), entry->opcode);
+	printf("%s#%-10llu 0x%03X: %-*s ; 0x%04X  I=0x%03X SP=%X DT=%02X ST=%02X",
+		label, (unsigned long long)number, entry->pc, MNEMONIC_MAX, mnemonic, entry->opcode, entry->index, entry->sp,
+		entry->delay_timer, entry->sound_timer);
+	for (int i = 0; i < 16; i++)
+	{
+		if ((entry->changed >> i) & 1) { printf(" V%X=%02X", i, entry->registers[i]); }
+	}
+	printf("\n");
+}
+
+/* Names (and A/B values) of the fields that differ between a and b */
+static void print_differences(const struct trace_entry *a, const struct trace_entry *b)
+{
+	printf("Differs in:");
+	if (a->pc != b->pc) { printf(" PC (0x%03X vs 0x%03X)", a->pc, b->pc); }
+	if (a->opcode != b->opcode) { printf(" opcode (0x%04X vs 0x%04X)", a->opcode, b->opcode); }
+	if (a->index != b->index) { printf(" I (0x%03X vs 0x%03X)", a->index, b->index); }
+	if (a->sp != b->sp) { printf(" SP (%X vs %X)", a->sp, b->sp); }
+	if (a->delay_timer != b->delay_timer) { printf(" DT (%02X vs %02X)", a->delay_timer, b->delay_timer); }
+	if (a->sound_timer != b->sound_timer) { printf(" ST (%02X vs %02X)", a->sound_timer, b->sound_timer); }
+	for (int i = 0; i < 16; i++)
+	{
+		if (a->registers[i] != b->registers[i]) { printf(" V%X (%02X vs %02X)", i, a->registers[i], b->registers[i]); }
+	}
+	printf("\n");
+}
+
+
+/* Compare two traces entry by entry
+* - Prints the TRACE_CONTEXT instructions both ran before the first difference, then both differing entries
+* - A trace that ends first (shorter run, or cut short) is reported as such
+*/
+int trace_diff(const char *path_a, const char *path_b)
+{
+	gzFile file_a = open_trace(path_a);
+	if (file_a == NULL) { return -1; }
+	gzFile file_b = open_trace(path_b);
+	if (file_b == NULL) { gzclose(file_a); return -1; }
+
+	static struct trace_entry entries_a[TRACE_BLOCK_ENTRIES], entries_b[TRACE_BLOCK_ENTRIES];
+	struct trace_entry context[TRACE_CONTEXT];
+	uint64_t matched = 0;
+	int result = 0;
+
+	while (1)
+	{
+		size_t count_a = read_entries(file_a, entries_a, TRACE_BLOCK_ENTRIES);
+		size_t count_b = read_entries(file_b, entries_b, TRACE_BLOCK_ENTRIES);
+		size_t count = (count_a < count_b) ? count_a : count_b;
+		size_t same = 0;
+		while (same < count && memcmp(&entries_a[same], &entries_b[same], sizeof(struct trace_entry)) == 0) { same++; }
+
+		for (size_t i = (same > TRACE_CONTEXT) ? same - TRACE_CONTEXT : 0; i < same; i++) // Keep the last few matches
+		{
+			context[(matched + i) % TRACE_CONTEXT] = entries_a[i];
+		}
+		matched += same;
+
+		if (same == count && count_a == count_b)
+		{
+			if (count == 0) { break; } // Both ended together
+			continue;
+		}
+
+		uint64_t first = (matched > TRACE_CONTEXT) ? matched - TRACE_CONTEXT : 0;
+		if (same < count) { printf("Traces diverge at instruction %llu\n\n", (unsigned long long)matched); }
+		else { printf("%s ends after %llu instructions, %s continues\n\n", (same == count_a) ? path_a : path_b, (unsigned long long)matched, (same == count_a) ? path_b : path_a); }
+		for (uint64_t i = first; i < matched; i++) { print_entry("  ", i, &context[i % TRACE_CONTEXT]); }
+		if (same < count_a) { print_entry("A ", matched, &entries_a[same]); }
+		if (same < count_b) { print_entry("B ", matched, &entries_b[same]); }
+		if (same < count) { print_differences(&entries_a[same], &entries_b[same]); }
+		result = 1;
+		break;
+	}
+
+	if (result == 0) { printf("Traces identical (%llu instructions)\n", (unsigned long long)matched); }
+	gzclose(file_a);
+	gzclose(file_b);
+	return result;
+}
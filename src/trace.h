@@ -0,0 +1,65 @@
+/*
+* PotatoCHIP-8 - Execution Trace Header
+*
+* Per-instruction binary trace recording and comparison
+*/
+
+/* PUBLIC FUNCTIONS
+   - trace_open()
+   - trace_close()
+   - trace_record()
+   - trace_diff()
+
+   PUBLIC STRUCTS
+   - trace_header
+   - trace_entry
+   - chip8_trace (opaque)
+*/
+
+#ifndef POTATOCHIP_TRACE
+#define POTATOCHIP_TRACE
+
+#include <stdint.h>
+#include <stddef.h>
+#include "chip8.h" // struct Chip8Memory
+
+#define TRACE_MAGIC "P8TRACE2"
+
+/* Start of a (decompressed) trace file */
+struct trace_header{
+	char magic[8];          // TRACE_MAGIC
+	uint32_t entry_size;    // sizeof(struct trace_entry)
+	uint32_t reserved;
+};
+
+/* One executed instruction, fixed width, host (little-endian) byte order
+* - Register values are after the instruction ran; changed marks which of them it wrote
+*   (unchanged registers repeat entry to entry, which gzip stores almost for free)
+*/
+struct trace_entry{
+	uint16_t pc;        // Address the instruction was fetched from
+	uint16_t opcode;
+	uint16_t index;     // I
+	uint16_t changed;   // Bit n set = Vn changed
+	uint8_t sp;
+	uint8_t delay_timer;
+	uint8_t sound_timer;
+	uint8_t reserved;
+	uint8_t registers[16]; // V0 - VF
+};
+
+struct chip8_trace;
+
+/* Create trace file (gzip-compressed) and start its writer thread. Returns NULL on failure */
+struct chip8_trace *trace_open(const char *path);
+
+/* Flush remaining entries, stop the writer thread, close the file, and print its size */
+void trace_close(struct chip8_trace *trace);
+
+/* Append the instruction at pc that just ran on machine (registers holds V0 - VF from before it ran) */
+void trace_record(struct chip8_trace *trace, const struct Chip8Memory *machine, uint16_t pc, uint16_t opcode, const uint8_t registers[16]);
+
+/* Print the first instruction where two trace files differ. Returns 0 if identical, 1 if they differ, -1 on error */
+int trace_diff(const char *path_a, const char *path_b);
+
+#endif // POTATOCHIP_TRACE